@@ -15,13 +15,23 @@
  * - <unistd.h>     : POSIX API (read, write, STDIN_FILENO, STDOUT_FILENO)
  */
 
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
 
@@ -29,6 +39,13 @@
 
 #define KILO_VERSION "0.0.1"
 
+#define KILO_TAB_STOP 8
+
+// stride, in source bytes, between entries of a row's width-checkpoint
+// index; byte<->column conversion is one table lookup plus at most this
+// many bytes of scanning
+#define KILO_WIDTH_CKPT 256
+
 /*
  * Macro: CTRL_KEY(k)
  * Converts a key to its Ctrl-key equivalent by masking with 0x1f (00011111).
@@ -37,6 +54,14 @@
  */
 #define CTRL_KEY(k) ((k) & 0x1f)
 
+// size of the buffered-input ring; a paste or a held-down key delivers many
+// bytes per read() and we want to grab them all in one syscall.
+#define KILO_INBUF_SIZE 4096
+
+// how long to wait for the remainder of an escape sequence that got split
+// across reads before deciding the user really pressed a bare ESC.
+#define KILO_ESC_TIMEOUT_MS 100
+
 enum editorKey {
   ARROW_LEFT = 1000,
   ARROW_RIGHT,
@@ -46,9 +71,131 @@ enum editorKey {
   HOME_KEY,
   END_KEY,
   PAGE_UP,
-  PAGE_DOWN
+  PAGE_DOWN,
+  WHEEL_UP,
+  WHEEL_DOWN,
+  FOCUS_IN,
+  FOCUS_OUT,
+  PASTE_START,
+  PASTE_END
+};
+
+// editorReadKey() returns KEY_NONE for input that was consumed but carries
+// no action for us (unrecognized sequences, mouse motion, focus events we
+// don't care about). editorProcessKeypress() falls through its switch on it.
+#define KEY_NONE 0
+
+enum editorHighlight {
+  HL_NORMAL = 0,
+  HL_COMMENT,
+  HL_MLCOMMENT,
+  HL_KEYWORD1,
+  HL_KEYWORD2,
+  HL_STRING,
+  HL_NUMBER
+};
+
+#define HL_HIGHLIGHT_NUMBERS (1 << 0)
+#define HL_HIGHLIGHT_STRINGS (1 << 1)
+
+// lexer state carried between rows and recorded at width checkpoints.
+// Zero means neutral text; a string delimiter character ('"' or '\'')
+// means "inside that string"; the two named values cover comments. Small
+// enough to store one byte per checkpoint.
+enum lexState {
+  LEX_NORMAL = 0,
+  LEX_MLCOMMENT = 1,
+  LEX_LINECOMMENT = 2
+};
+
+/*** stats ***/
+
+/*
+ * Hot-path instrumentation. The counters are plain increments on paths
+ * that already do real work, so they stay compiled in; what costs money -
+ * composing the HUD line, formatting the exit dump - only happens when
+ * asked for. Ctrl-G toggles a status-line HUD showing the previous
+ * frame's numbers; setting the KILO_STATS environment variable makes the
+ * process print cumulative key=value totals to stderr on exit, for
+ * scraping into a dashboard.
+ */
+struct editorStats {
+  int hud;               // HUD overlay enabled (Ctrl-G)
+  long frames;           // editorRefreshScreen() calls
+  long bytes;            // bytes written to the terminal, total
+  long abappends;        // abAppend() calls, total
+  long rows_materialized; // rows filled in from the offset index
+  long inqueue;          // input bytes still buffered, sampled per frame
+  double frame_ms;       // last frame's compose+write time
+  double frame_ms_total;
+  double frame_ms_max;
+  // previous totals, so the HUD can show per-frame deltas
+  long prev_bytes, prev_abappends, prev_rows;
+};
+
+struct editorStats S;
+
+// registered via atexit() when KILO_STATS is set in the environment: one
+// key=value line on stderr that a wrapper script or dashboard scraper can
+// pick up. atexit handlers run last-in first-out and statsDump is
+// registered after disableRawMode, so this prints while the terminal is
+// still raw (OPOST off) - hence the explicit \r\n.
+void statsDump(void) {
+  fprintf(stderr,
+          "kilo_stats frames=%ld bytes=%ld abappend=%ld "
+          "rows_materialized=%ld frame_ms_avg=%.3f frame_ms_max=%.3f\r\n",
+          S.frames, S.bytes, S.abappends, S.rows_materialized,
+          S.frames ? S.frame_ms_total / S.frames : 0.0, S.frame_ms_max);
+}
+
+/*** append buffer ***/
+
+// an append buffer consists of a pointer to our buffer in memory, a length,
+// and a capacity. we define ABUF_INIT constant which represents an empty
+// buffer. This acts as a constructor for our abuf type.
+//
+// the capacity field is what keeps the render path off the allocator:
+// abAppend() used to realloc() on every single call, and editorDrawRows()
+// appends one byte at a time for tildes and padding, so a single frame could
+// be hundreds of reallocs. with geometric growth the buffer reaches its
+// steady-state size after the first frame or two and appends become a plain
+// memcpy from then on.
+
+struct abuf {
+  char *b;
+  int len;
+  int cap;
 };
 
+#define ABUF_INIT {NULL, 0, 0}
+
+void abAppend(struct abuf *ab, const char *s, int len) {
+  S.abappends++;
+  if (ab->len + len > ab->cap) {
+    int cap = ab->cap ? ab->cap : 64;
+    while (cap < ab->len + len)
+      cap *= 2;
+    char *new = realloc(ab->b, cap);
+    if (new == NULL)
+      return;
+    ab->b = new;
+    ab->cap = cap;
+  }
+  memcpy(&ab->b[ab->len], s, len);
+  ab->len += len;
+}
+
+// abFree() is a destructor that deallocates the dynamic memory used by an
+// abuf. the persistent frame buffer on editorConfig is deliberately never
+// freed - it lives for the whole session and is reset with len = 0 instead.
+
+void abFree(struct abuf *ab) {
+  free(ab->b);
+  ab->b = NULL;
+  ab->len = 0;
+  ab->cap = 0;
+}
+
 /*** data ***/
 
 /*
@@ -66,24 +213,270 @@ enum editorKey {
  * instead of struct erow.
  */
 
+// chars normally points at heap memory that the row owns, but when a file is
+// loaded through mmap() it points straight into the read-only mapping instead.
+// the owned flag records which case we are in: only owned rows may be freed or
+// modified in place, so unmodified lines of a multi-gigabyte file never cost
+// a malloc or a copy.
+
+// the hl fields are the per-row highlight cache: hl is one editorHighlight
+// byte per character, hl_valid says whether it is current, and hl_oc_end
+// records the lexer state (inside a multi-line comment or not) at the END
+// of the row, which is the entry state of the row below. Rows are lexed
+// lazily when drawn, never eagerly for the whole file.
+
+// render/rsize are the display form of the row - tabs expanded to spaces,
+// control characters made printable as ^X - computed lazily the first time
+// the row is drawn and cached from then on. chars stays the source of
+// truth; render is NULL until needed, so off-screen rows never pay for
+// expansion. The highlighter lexes the render string, keeping hl indices
+// aligned with what is actually on screen.
+
 typedef struct erow {
   int size;
   char *chars;
+  int owned;
+  char *render;
+  int rsize;
+  int *wck_rx; // width checkpoints: display column at every
+               // KILO_WIDTH_CKPT'th byte of chars; NULL until built
+  unsigned char *wck_st; // lexer state at the same checkpoints, so a
+                         // slice of the row can be highlighted without
+                         // lexing from byte zero; NULL when no syntax
+  int nwck;
+  unsigned char *hl;
+  int hl_valid;
+  int hl_oc_end;
+  int vrows;     // wrap mode: visual lines this row occupies, 0 = unmeasured
+  unsigned vgen; // wrap generation vrows was measured at (see editorWrapSync)
 } erow;
 
-struct editorConfig {
+/*
+ * editorSyntax describes one language for the highlighter: the strings
+ * that identify files of that type, the keyword list (terminated by NULL,
+ * with type-keywords marked by a trailing '|'), and the comment markers.
+ */
+struct editorSyntax {
+  char *filetype;
+  char **filematch;
+  char **keywords;
+  char *singleline_comment_start;
+  char *multiline_comment_start;
+  char *multiline_comment_end;
+  int flags;
+};
+
+/*
+ * Arena (bump) allocator for row text
+ *
+ * Owned row text is carved out of large slabs instead of getting one malloc
+ * per line: allocation is a pointer bump, there is no per-line free, and the
+ * allocator metadata overhead per line is zero. Slabs are chained so the
+ * arena can grow without moving existing allocations (rows keep pointing at
+ * their text forever). Individual rows are never freed - the whole arena is
+ * released at once, which matches how the editor actually uses row memory.
+ */
+
+#define ARENA_SLAB_SIZE (1 << 20)
+
+struct arenaSlab {
+  struct arenaSlab *next;
+  size_t used;
+  size_t cap;
+  char buf[];
+};
+
+struct arena {
+  struct arenaSlab *head;
+};
+
+/*
+ * Undo deltas
+ *
+ * Undo history is a stack of small delta records, not buffer snapshots.
+ * This works because row text is immutable once created: it lives either in
+ * the read-only file mapping or in the arena (which never frees or reuses a
+ * span), so a delta can share it by reference. A record for n deleted rows
+ * is n erow structs - 16 bytes each - regardless of how much text those
+ * rows carry, which is what keeps a deep history affordable on a 2 GB
+ * buffer.
+ *
+ * The stack has a cursor, B->undopos: entries below it are undoable, entries
+ * at or above it are redoable. Recording a fresh edit truncates the redo
+ * tail, like every editor.
+ */
+
+enum editOp { EDIT_INSERT_ROWS, EDIT_DELETE_ROWS };
+
+struct editDelta {
+  int op;
+  int at;     // first row index affected
+  int n;      // number of rows
+  erow *rows; // the removed rows' metadata (text shared, never copied);
+              // NULL for an insert that has not been undone yet
+  int cx, cy; // cursor position before the edit, restored on undo
+};
+
+// one search hit; the match index on editorConfig is a sorted array of these
+struct searchMatch {
+  int row;
+  int col;
+};
+
+/*
+ * Worker pool
+ *
+ * A small fixed set of threads (one per online CPU) that the main loop can
+ * hand whole-buffer jobs to - line indexing, search scans, future syntax
+ * passes - so nothing that walks gigabytes ever runs on the thread that
+ * services keystrokes.
+ *
+ * A job is a fn run on some worker plus an optional done callback. Workers
+ * never touch editor state; they only read the buffer range they were given
+ * and write into their own job. done callbacks are deferred onto a
+ * completion list that the MAIN thread drains before each refresh, so all
+ * mutation of E stays single-threaded. A self-pipe wakes the poll()-based
+ * event loop when results arrive while the editor is idle.
+ */
+
+struct poolJob {
+  void (*fn)(void *arg);   // runs on a worker thread
+  void (*done)(void *arg); // runs on the main thread at drain time (or NULL)
+  void *arg;
+  struct poolJob *next;
+};
+
+struct workerPool {
+  pthread_t *threads;
+  int nthreads;
+  pthread_mutex_t lock;
+  pthread_cond_t hasjob;
+  pthread_cond_t idle;
+  struct poolJob *jobs, *jobtail;      // pending, FIFO
+  struct poolJob *donehead, *donetail; // completed, awaiting the main thread
+  int pending;                         // submitted and not yet finished
+  int wakefd_r, wakefd_w;              // self-pipe into the event loop
+};
+
+char *arenaAlloc(struct arena *a, size_t len) {
+  if (a->head == NULL || a->head->cap - a->head->used < len) {
+    size_t cap = len > ARENA_SLAB_SIZE ? len : ARENA_SLAB_SIZE;
+    struct arenaSlab *slab = malloc(sizeof(struct arenaSlab) + cap);
+    if (slab == NULL)
+      return NULL;
+    slab->next = a->head;
+    slab->used = 0;
+    slab->cap = cap;
+    a->head = slab;
+  }
+  char *p = a->head->buf + a->head->used;
+  a->head->used += len;
+  return p;
+}
+
+void arenaRelease(struct arena *a) {
+  struct arenaSlab *slab = a->head;
+  while (slab) {
+    struct arenaSlab *next = slab->next;
+    free(slab);
+    slab = next;
+  }
+  a->head = NULL;
+}
+
+/*
+ * editorBuffer holds everything that belongs to one open file: the row
+ * table and its gap, the text and render arenas, the mapping and offset
+ * index, cursor and scroll position, undo history, search state, and the
+ * chosen syntax. Several of these coexist in one process; the terminal
+ * itself - screen size, frame and damage buffers, the input queue, the
+ * worker pool - stays on editorConfig and is shared by all of them.
+ */
+struct editorBuffer {
   int cx, cy;
+  int rx;
   int rowoff;
   int coloff;
-  int screenrows;
-  int screencols;
   int numrows;
+  int rowcap;
+  int rowgap_start;
+  int rowgap_end;
   erow *row;
+  struct arena rowarena;
+  struct arena renderarena;
+  struct editDelta *undo;
+  int nundo;
+  int undocap;
+  int undopos;
+  int bufedited;
+  struct searchMatch *matches;
+  int nmatches;
+  int matchcap;
+  char matchquery[256];
+  int matchquerylen;
+  int matchdirty;
+  char *filename;
+  struct editorSyntax *syntax;
+  char *filemap;
+  size_t filemap_len;
+  int filemap_mmapped;
+  size_t *lineoff;
+  int follow; // tail -f mode: watch the file and keep indexing appends
+  int wd;     // inotify watch descriptor while following, else 0
+  int prefetch_row;            // rowoff last time the prefetcher looked,
+                               // giving it the scroll direction
+  size_t prefetch_lo, prefetch_hi; // byte window already advised WILLNEED
+  int wrap;         // soft word wrap (Ctrl-W): long lines fold at the screen
+                    // edge instead of scrolling off it
+  int wrapcols;     // screen width the wrap cache was measured at
+  unsigned wrapgen; // bumped when wrapcols changes; a row whose vgen does
+                    // not match is unmeasured at the current width
+  int rowsub;       // wrap mode: visual line of row rowoff at the screen top
+  long *vtree;      // Fenwick tree over per-row visual-line counts
+  int vtreen;       // rows the tree covers
+  int vtree_dirty;  // rows inserted/deleted/respliced since the last build
+  unsigned lastused; // buffer-switch clock tick of the last activation,
+                     // consulted by the LRU cache eviction
+};
+
+struct editorConfig {
+  int screenrows;
+  int screencols;
+  struct editorBuffer **bufs;
+  int nbufs;
+  int bufcap;
+  int curbuf;
+  unsigned bufclock;
+  int inotfd; // shared inotify instance for follow mode, -1 if unavailable
+  struct workerPool pool;
+  struct abuf frame;
+  struct abuf linebuf;
+  struct abuf *rowcache;
+  int fullrepaint;
+  char inbuf[KILO_INBUF_SIZE];
+  int inlen;
+  int inpos;
   struct termios orig_termios;
 };
 
 struct editorConfig E;
 
+// the buffer all editing operations act on; editorBufferSwitch() repoints
+// it. A plain pointer keeps the hot paths free of any indirection through
+// the buffer table.
+struct editorBuffer *B;
+
+#ifdef KILO_BENCH
+// the headless benchmark driver (see the bench section at the bottom of
+// this file) counts every frame and byte the refresh path produces
+long bench_frames = 0;
+long bench_bytes = 0;
+#endif
+
+/*** prototypes ***/
+
+void editorSelectSyntaxHighlight();
+
 /*** terminal ***/
 
 /*
@@ -118,6 +511,8 @@ void die(const char *s) {
  * output is drained and input is discarded.
  */
 void disableRawMode() {
+  write(STDOUT_FILENO, "\x1b[?2004l", 8);
+
   if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &E.orig_termios) == -1)
     die("tcsetattr");
 }
@@ -268,6 +663,10 @@ void enableRawMode() {
   // second, so we set it to 1/10 of second, or 100ms. if read() times out, it
   // will return 0, which makes sense because its usual return value is the
   // number of bytes read.
+  //
+  // note that since the main loop now blocks in poll() until input arrives,
+  // the VTIME timeout no longer drives a 10 Hz wakeup/redraw cycle; it only
+  // bounds the short follow-up reads inside an escape sequence.
 
   // after the attributes have been modified, you can then apply them to the
   // terminal using tcsetattr(). the TCSAFLUSH argument specifies when to apply
@@ -275,64 +674,250 @@ void enableRawMode() {
   // the terminal, and also discards any input that hasn’t been read.
   if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)
     die("tcsetattr");
+
+  // turn on bracketed paste mode (xterm private mode 2004): the terminal
+  // wraps pasted text in ESC[200~ ... ESC[201~, letting us tell a 5,000-line
+  // paste apart from 5,000 keystrokes and handle it as one bulk insert.
+  // disableRawMode() turns it back off on exit.
+  write(STDOUT_FILENO, "\x1b[?2004h", 8);
 }
 
 /*
- * editorReadKey() - Wait for and return a single keypress
+ * inputRefill() - Top up the buffered-input ring with one read() syscall
  *
- * Reads from stdin in a loop until a character is received.
- * Handles EAGAIN errors (expected from non-blocking reads with timeout).
- * Dies on any other read error.
+ * Grabs everything the terminal has delivered so far in a single read()
+ * into E.inbuf, instead of the old one-byte-per-syscall pattern. A paste or
+ * a key held at 50 Hz arrives as a burst, and one refill swallows the whole
+ * burst.
+ *
+ * timeout_ms controls how long to wait for data to show up:
+ *   -1 : block until input (or a signal) arrives - the idle state
+ *    0 : only take what is already queued in the kernel
+ *   >0 : wait briefly, used to collect the tail of a split escape sequence
+ *
+ * Returns: 1 if new bytes were added to the buffer, 0 otherwise
  */
-int editorReadKey() {
-  int nread;
-  char c;
-
-  while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-    if (nread == -1 && errno != EAGAIN) die("read");
-  }
-
-  if (c == '\x1b') {
-    char seq[3];
-
-    if (read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-    if (read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
-
-    if (seq[0] == '[') {
-      if (seq[1] >= '0' && seq[1] <= '9') {
-        if (read(STDIN_FILENO, &seq[2], 1) != 1) return '\x1b';
-        if (seq[2] == '~') {
-          switch (seq[1]) {
-            case '1': return HOME_KEY;
-            case '3': return DEL_KEY;
-            case '4': return END_KEY;
-            case '5': return PAGE_UP;
-            case '6': return PAGE_DOWN;
-            case '7': return HOME_KEY;
-            case '8': return END_KEY;
-          }
-        }
-      } else {
-        switch (seq[1]) {
-          case 'A': return ARROW_UP;
-          case 'B': return ARROW_DOWN;
-          case 'C': return ARROW_RIGHT;
-          case 'D': return ARROW_LEFT;
-          case 'H': return HOME_KEY;
-          case 'F': return END_KEY;
-        }
-      }
-    } else if (seq[0] == 'O') {
-      switch (seq[1]) {
-        case 'H': return HOME_KEY;
-        case 'F': return END_KEY;
-      }
+int inputRefill(int timeout_ms) {
+  if (E.inpos == E.inlen) {
+    E.inpos = 0;
+    E.inlen = 0;
+  }
+  if (E.inlen == KILO_INBUF_SIZE)
+    return 0;
+
+  struct pollfd pfd;
+  pfd.fd = STDIN_FILENO;
+  pfd.events = POLLIN;
+  int r = poll(&pfd, 1, timeout_ms);
+  if (r == -1 && errno != EINTR)
+    die("poll");
+  if (r <= 0)
+    return 0;
+
+  ssize_t n = read(STDIN_FILENO, E.inbuf + E.inlen, KILO_INBUF_SIZE - E.inlen);
+  if (n == -1 && errno != EAGAIN)
+    die("read");
+  if (n <= 0)
+    return 0;
+  E.inlen += n;
+  return 1;
+}
+
+/*
+ * editorPendingInput() - Is there a buffered byte waiting to be parsed?
+ */
+int editorPendingInput() { return E.inpos < E.inlen; }
+
+/*
+ * editorWaitForEvent() - Block until there is something to do
+ *
+ * Parks the process in poll() (inside inputRefill) with no timeout. The old
+ * main loop relied on the VTIME read timeout, which meant kilo woke up and
+ * repainted the whole screen ten times a second even when completely idle;
+ * with a blocking poll an idle editor consumes zero CPU. An EINTR return is
+ * treated as an event too, so signals (e.g. a future SIGWINCH handler) can
+ * wake the loop for a repaint.
+ */
+void editorWaitForEvent() {
+  if (editorPendingInput())
+    return;
+
+  // wait on the terminal, the worker pool's wake pipe, and (when follow
+  // mode has a watch somewhere) the inotify fd, so a result or a file
+  // append arriving while we are idle still triggers a repaint
+  struct pollfd pfds[3];
+  pfds[0].fd = STDIN_FILENO;
+  pfds[0].events = POLLIN;
+  pfds[1].fd = E.pool.wakefd_r;
+  pfds[1].events = POLLIN;
+  int nfds = 2;
+  if (E.inotfd != -1) {
+    pfds[2].fd = E.inotfd;
+    pfds[2].events = POLLIN;
+    nfds = 3;
+  }
+  int r = poll(pfds, nfds, -1);
+  if (r == -1 && errno != EINTR)
+    die("poll");
+  if (r > 0 && (pfds[0].revents & POLLIN))
+    inputRefill(0);
+}
+
+/*
+ * inputNextByte() - Pull one byte out of the input buffer
+ *
+ * Refills (bounded by timeout_ms) if the buffer is empty, so mid-sequence
+ * parsing can wait briefly for the tail of a split escape sequence.
+ *
+ * Returns: the byte, or -1 if none arrived within the timeout
+ */
+int inputNextByte(int timeout_ms) {
+  if (!editorPendingInput() && !inputRefill(timeout_ms))
+    return -1;
+  return (unsigned char)E.inbuf[E.inpos++];
+}
+
+/*
+ * CSI escape sequence parser
+ *
+ * Per ECMA-48 / xterm, a CSI sequence is ESC [ followed by:
+ *   - an optional private marker  ('<', '=', '>', '?')
+ *   - any number of parameter bytes (digits and ';')
+ *   - any number of intermediate bytes (0x20-0x2f)
+ *   - exactly one final byte (0x40-0x7e) that selects the function
+ *
+ * editorParseCsi() is a small state machine over those byte classes: it
+ * accumulates numeric parameters generically and then dispatches on the
+ * final byte through lookup tables, instead of the old hand-rolled if
+ * ladder that recognized a handful of sequences and dropped the rest after
+ * several timeout-bound 1-byte reads. Because it consumes from the buffered
+ * input, a whole burst of sequences (mouse reports, key repeat) parses with
+ * zero extra syscalls, and unknown sequences are consumed cleanly instead
+ * of leaking their bytes into the buffer as junk keystrokes.
+ */
+
+#define CSI_MAX_PARAMS 8
+
+// final byte -> key, for CSI sequences without a '~'
+static const struct {
+  char final;
+  int key;
+} csiFinalKeys[] = {
+    {'A', ARROW_UP},  {'B', ARROW_DOWN}, {'C', ARROW_RIGHT}, {'D', ARROW_LEFT},
+    {'H', HOME_KEY},  {'F', END_KEY},    {'I', FOCUS_IN},    {'O', FOCUS_OUT},
+};
+
+// first parameter -> key, for CSI <n> ~ sequences
+static const struct {
+  int param;
+  int key;
+} csiTildeKeys[] = {
+    {1, HOME_KEY},      {3, DEL_KEY},   {4, END_KEY},
+    {5, PAGE_UP},       {6, PAGE_DOWN}, {7, HOME_KEY},
+    {8, END_KEY},       {200, PASTE_START}, {201, PASTE_END},
+};
+
+int editorParseCsi() {
+  int params[CSI_MAX_PARAMS];
+  int nparams = 0;
+  int value = -1;
+  char priv = 0;
+  char final = 0;
+
+  for (;;) {
+    int b = inputNextByte(KILO_ESC_TIMEOUT_MS);
+    if (b == -1)
+      return KEY_NONE;
+    if (b >= '0' && b <= '9') {
+      value = (value == -1 ? 0 : value) * 10 + (b - '0');
+    } else if (b == ';') {
+      if (nparams < CSI_MAX_PARAMS)
+        params[nparams++] = (value == -1) ? 0 : value;
+      value = -1;
+    } else if (b == '<' || b == '=' || b == '>' || b == '?') {
+      priv = b;
+    } else if (b >= 0x20 && b <= 0x2f) {
+      // intermediate bytes: accepted, nothing we handle uses them
+    } else if (b >= 0x40 && b <= 0x7e) {
+      final = b;
+      break;
+    } else {
+      return KEY_NONE;
+    }
+  }
+  if (value != -1 && nparams < CSI_MAX_PARAMS)
+    params[nparams++] = value;
+
+  // SGR mouse report: ESC [ < button;col;row (M=press, m=release).
+  // buttons 64/65 are the scroll wheel; everything else is ignored for now.
+  if (priv == '<' && (final == 'M' || final == 'm')) {
+    if (final == 'M' && nparams >= 1) {
+      if (params[0] == 64)
+        return WHEEL_UP;
+      if (params[0] == 65)
+        return WHEEL_DOWN;
     }
+    return KEY_NONE;
+  }
 
-    return '\x1b';
-  } else {
+  if (final == '~') {
+    int p = nparams ? params[0] : 0;
+    for (size_t i = 0; i < sizeof(csiTildeKeys) / sizeof(csiTildeKeys[0]); i++)
+      if (csiTildeKeys[i].param == p)
+        return csiTildeKeys[i].key;
+    return KEY_NONE;
+  }
+
+  // a second parameter, when present, is a modifier mask (shift/alt/ctrl);
+  // we don't bind modified keys yet, so dispatch on the base key.
+  for (size_t i = 0; i < sizeof(csiFinalKeys) / sizeof(csiFinalKeys[0]); i++)
+    if (csiFinalKeys[i].final == final)
+      return csiFinalKeys[i].key;
+  return KEY_NONE;
+}
+
+/*
+ * editorReadKey() - Return the next keypress from the input buffer
+ *
+ * Consumes bytes out of E.inbuf, refilling it when empty. Escape sequences
+ * are parsed from bytes already in memory by the CSI state machine; only
+ * when a sequence is split across reads do we wait (bounded by
+ * KILO_ESC_TIMEOUT_MS) for the rest, so the common case costs zero extra
+ * syscalls and a bare ESC keypress is still recognized after the grace
+ * period.
+ */
+int editorReadKey() {
+  if (!editorPendingInput() && !inputRefill(-1))
+    return KEY_NONE;
+
+  char c = E.inbuf[E.inpos++];
+  if (c != '\x1b')
     return c;
+
+  int b = inputNextByte(KILO_ESC_TIMEOUT_MS);
+  if (b == -1)
+    return '\x1b';
+
+  if (b == '[')
+    return editorParseCsi();
+
+  if (b == 'O') {
+    // SS3 sequences: application-mode cursor keys and PF1-PF4
+    switch (inputNextByte(KILO_ESC_TIMEOUT_MS)) {
+      case 'A': return ARROW_UP;
+      case 'B': return ARROW_DOWN;
+      case 'C': return ARROW_RIGHT;
+      case 'D': return ARROW_LEFT;
+      case 'H': return HOME_KEY;
+      case 'F': return END_KEY;
+    }
+    return KEY_NONE;
   }
+
+  // ESC followed by an ordinary byte (e.g. Alt-modified key): report the
+  // ESC and leave the byte in the buffer for the next call.
+  E.inpos--;
+  return '\x1b';
 }
 
 /*
@@ -404,6 +989,49 @@ int getWindowSize(int *rows, int *cols) {
   }
 }
 
+// set from the SIGWINCH handler; a sig_atomic_t flag is the only state an
+// async signal handler may safely touch, so all real resize work happens
+// on the main thread when it next looks at the flag
+static volatile sig_atomic_t winch_pending = 0;
+
+void handleSigwinch(int sig) {
+  (void)sig;
+  winch_pending = 1;
+}
+
+/*
+ * editorCheckResize() - Apply a pending terminal resize
+ *
+ * Called once per main-loop iteration; costs a single flag test when
+ * nothing changed. When SIGWINCH has fired, re-query the size with one
+ * TIOCGWINSZ ioctl (never the escape-sequence fallback - the terminal
+ * that just delivered the signal can certainly answer the ioctl), resize
+ * the per-screen-row damage cache to match, and force a full repaint.
+ * The handler is installed without SA_RESTART so the signal breaks the
+ * idle poll() with EINTR and the loop comes around immediately.
+ */
+void editorCheckResize() {
+  if (!winch_pending)
+    return;
+  winch_pending = 0;
+
+  struct winsize ws;
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
+    return;
+  if (ws.ws_row == E.screenrows && ws.ws_col == E.screencols)
+    return;
+
+  for (int y = 0; y < E.screenrows; y++)
+    abFree(&E.rowcache[y]);
+  free(E.rowcache);
+  E.screenrows = ws.ws_row;
+  E.screencols = ws.ws_col;
+  E.rowcache = calloc(E.screenrows, sizeof(struct abuf));
+  if (E.rowcache == NULL)
+    die("calloc");
+  E.fullrepaint = 1;
+}
+
 // ioctl() isn’t guaranteed to be able to request the window size on all
 // systems, so we are going to provide a fallback method of getting the window
 // size.
@@ -423,153 +1051,2086 @@ int getWindowSize(int *rows, int *cols) {
 // command is that the documentation doesn’t specify what happens when you try
 // to move the cursor off-screen.
 
-/*** row operations ***/
-
-void editorAppendRow(char *s, size_t len) {
-  E.row = realloc(E.row, sizeof(erow) * (E.numrows + 1));
-  int at = E.numrows;
-  E.row[at].size = len;
-  E.row[at].chars = malloc(len + 1);
-  memcpy(E.row[at].chars, s, len);
-  E.row[at].chars[len] = '\0';
-  E.numrows++;
+/*** worker pool ***/
+
+void *poolWorker(void *v) {
+  (void)v;
+  for (;;) {
+    pthread_mutex_lock(&E.pool.lock);
+    while (E.pool.jobs == NULL)
+      pthread_cond_wait(&E.pool.hasjob, &E.pool.lock);
+    struct poolJob *job = E.pool.jobs;
+    E.pool.jobs = job->next;
+    if (E.pool.jobs == NULL)
+      E.pool.jobtail = NULL;
+    pthread_mutex_unlock(&E.pool.lock);
+
+    job->fn(job->arg);
+
+    pthread_mutex_lock(&E.pool.lock);
+    if (job->done) {
+      job->next = NULL;
+      if (E.pool.donetail)
+        E.pool.donetail->next = job;
+      else
+        E.pool.donehead = job;
+      E.pool.donetail = job;
+      // poke the event loop so results get drained even while idle; the
+      // pipe is non-blocking and a full pipe just means a wakeup is
+      // already queued
+      if (write(E.pool.wakefd_w, "x", 1) == -1 && errno != EAGAIN) {
+        // nothing useful to do; the next keypress will drain us
+      }
+    } else {
+      free(job);
+    }
+    E.pool.pending--;
+    if (E.pool.pending == 0)
+      pthread_cond_signal(&E.pool.idle);
+    pthread_mutex_unlock(&E.pool.lock);
+  }
+  return NULL;
 }
 
-/*** file i/o ***/
-
-void editorOpen(char *filename) {
-  FILE *fp = fopen(filename, "r");
-  if(!fp) die("fopen");
-
-  char *line = NULL;
-  size_t linecap = 0;
-  ssize_t linelen;
-  while ((linelen = getline(&line, &linecap, fp)) != -1) {
-    while (linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
-      linelen--;
+/*
+ * poolSubmit() - Queue a job for the workers
+ *
+ * fn runs on a worker; done (may be NULL) runs later on the main thread
+ * when poolDrain() is called. The job node is freed after done returns, or
+ * right after fn when there is no done callback.
+ */
+void poolSubmit(void (*fn)(void *), void (*done)(void *), void *arg) {
+  struct poolJob *job = malloc(sizeof(struct poolJob));
+  if (job == NULL)
+    die("malloc");
+  job->fn = fn;
+  job->done = done;
+  job->arg = arg;
+  job->next = NULL;
+
+  pthread_mutex_lock(&E.pool.lock);
+  if (E.pool.jobtail)
+    E.pool.jobtail->next = job;
+  else
+    E.pool.jobs = job;
+  E.pool.jobtail = job;
+  E.pool.pending++;
+  pthread_cond_signal(&E.pool.hasjob);
+  pthread_mutex_unlock(&E.pool.lock);
+}
 
-    editorAppendRow(line, linelen);
+/*
+ * poolDrain() - Run completed jobs' done callbacks on the main thread
+ *
+ * Called from the main loop before each refresh. Since this is the only
+ * place results re-enter editor state, workers never need to lock E.
+ */
+void poolDrain() {
+  char sink[64];
+  while (read(E.pool.wakefd_r, sink, sizeof(sink)) > 0)
+    ;
+
+  pthread_mutex_lock(&E.pool.lock);
+  struct poolJob *job = E.pool.donehead;
+  E.pool.donehead = E.pool.donetail = NULL;
+  pthread_mutex_unlock(&E.pool.lock);
+
+  while (job) {
+    struct poolJob *next = job->next;
+    job->done(job->arg);
+    free(job);
+    job = next;
   }
-  free(line);
-  fclose(fp);
 }
-// malloc() comes from <stdlib.h>. ssize_t comes from <sys/types.h>.
-// FILE, fopen(), and getline() come from <stdio.h>.
-// editorOpen() now takes a filename and opens the file for reading using fopen().
-// We allow the user to choose a file to open by checking if they passed a filename as a
-// command line argument. If they did, we call editorOpen() and pass it the filename.
-// If they ran ./kilo with no arguments, editorOpen() will not be called and they’ll start with a blank file.
-
-/*** append buffer ***/
-struct abuf {
-  char *b;
-  int len;
-};
-
-#define ABUF_INIT {NULL, 0}
 
-// an append buffer consists of a pointer to our buffer in memory, and a length.
-// we define ABUF_INIT constant which represents an empty buffer. This acts as a
-// constructor for our abuf type.
-
-void abAppend(struct abuf *ab, const char *s, int len) {
-  char *new = realloc(ab->b, ab->len + len);
+/*
+ * poolWait() - Block until every submitted job has finished
+ *
+ * For the few operations that need their result synchronously (e.g. the
+ * parallel open-time index). Follow with poolDrain() if the jobs had done
+ * callbacks.
+ */
+void poolWait() {
+  pthread_mutex_lock(&E.pool.lock);
+  while (E.pool.pending > 0)
+    pthread_cond_wait(&E.pool.idle, &E.pool.lock);
+  pthread_mutex_unlock(&E.pool.lock);
+}
 
-  if (new == NULL)
-    return;
-  memcpy(&new[ab->len], s, len);
-  ab->b = new;
-  ab->len += len;
+void poolInit() {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  E.pool.nthreads = (n > 0) ? (int)n : 1;
+
+  pthread_mutex_init(&E.pool.lock, NULL);
+  pthread_cond_init(&E.pool.hasjob, NULL);
+  pthread_cond_init(&E.pool.idle, NULL);
+  E.pool.jobs = E.pool.jobtail = NULL;
+  E.pool.donehead = E.pool.donetail = NULL;
+  E.pool.pending = 0;
+
+  int pipefd[2];
+  if (pipe(pipefd) == -1)
+    die("pipe");
+  fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+  fcntl(pipefd[1], F_SETFL, O_NONBLOCK);
+  E.pool.wakefd_r = pipefd[0];
+  E.pool.wakefd_w = pipefd[1];
+
+  E.pool.threads = malloc(sizeof(pthread_t) * E.pool.nthreads);
+  if (E.pool.threads == NULL)
+    die("malloc");
+  for (int i = 0; i < E.pool.nthreads; i++)
+    if (pthread_create(&E.pool.threads[i], NULL, poolWorker, NULL) != 0)
+      die("pthread_create");
 }
 
-void abFree(struct abuf *ab) { free(ab->b); }
+/*** buffers ***/
 
-// realloc() and free() come from <stdlib.h>. memcpy() comes from <string.h>.
-// To append a string s to an abuf, the first thing we do is make sure we
-// allocate enough memory to hold the new string. We ask realloc() to give us a
-// block of memory that is the size of the current string plus the size of the
-// string we are appending. realloc() will either extend the size of the block
-// of memory we already have allocated, or it will take care of free()ing the
-// current block of memory and allocating a new block of memory somewhere else
-// that is big enough for our new string.
-//
-// then we use memcpy() to copy the string s after the end of the current data
-// in the buffer, and we update pointer and length of the abuf to the new
-// values.
-//
-// abFree() is a destructor that deallocates the dynamic memory user by an abuf.
+/*
+ * One editor process, several open files. Each buffer carries its own row
+ * table, arenas and mapping (see struct editorBuffer); what is shared is
+ * everything that exists once per terminal - the screen, the input queue,
+ * the worker pool - plus this registry. Tailing one log while
+ * cross-referencing two others no longer means three processes each
+ * paying full freight.
+ *
+ * Background buffers are cheap by construction (an inactive mapped file
+ * is just its mmap and offset index), but render strings and highlight
+ * caches accumulate as buffers get used. editorBufferSwitch() therefore
+ * runs a small LRU sweep: when the render arenas of background buffers
+ * exceed a budget, the coldest buffer's caches are dropped. Only derived
+ * data is ever evicted - row text, edits and undo history are untouched -
+ * so coming back to an evicted buffer just re-renders the viewport.
+ */
 
-/*** output ***/
+// combined render-arena budget for buffers that are not on screen
+#define KILO_BG_CACHE_BUDGET (32 << 20)
 
 /*
- * Display and Rendering Functions
+ * editorBufferAdd() - Create an empty buffer and register it
  *
- * This section handles all screen output including:
- * - Drawing rows of tildes (like vim)
- * - Screen refresh and clearing
+ * Returns the new buffer's index. All per-buffer fields start zeroed,
+ * which is exactly the empty-buffer state. Does not switch to it.
  */
-
-void editorScroll() {
-  if(E.cy < E.rowoff) {
-    E.rowoff = E.cy;
-  }
-  if(E.cy >= E.rowoff + E.screenrows) {
-    E.rowoff = E.cy - E.screenrows + 1;
-  }
-  if(E.cx < E.coloff) {
-    E.coloff = E.cx;
-  }
-  if(E.cx >= E.coloff + E.screencols) {
-    E.coloff = E.cx - E.screencols + 1;
+int editorBufferAdd() {
+  if (E.nbufs == E.bufcap) {
+    E.bufcap = E.bufcap ? E.bufcap * 2 : 4;
+    E.bufs = realloc(E.bufs, sizeof(struct editorBuffer *) * E.bufcap);
+    if (E.bufs == NULL)
+      die("realloc");
   }
+  struct editorBuffer *buf = calloc(1, sizeof(struct editorBuffer));
+  if (buf == NULL)
+    die("calloc");
+  buf->lastused = ++E.bufclock;
+  E.bufs[E.nbufs] = buf;
+  return E.nbufs++;
 }
 
-
 /*
- * editorDrawRows() - Draw tilde rows on screen
+ * editorBufferCacheBytes() - Derived-cache footprint of one buffer
  *
- * Draws a column of tildes (~) down the left side of the screen, similar to
- * vim's display for lines past the end of the buffer.
+ * Counts the render arena's slabs; highlight and checkpoint allocations
+ * track the rendered rows closely enough that the arena alone is an
+ * honest proxy for "how much this buffer's caches cost".
  */
-void editorDrawRows(struct abuf *ab) {
-  int y;
+size_t editorBufferCacheBytes(struct editorBuffer *buf) {
+  size_t total = 0;
+  for (struct arenaSlab *slab = buf->renderarena.head; slab;
+       slab = slab->next)
+    total += slab->cap;
+  return total;
+}
 
-  for (y = 0; y < E.screenrows; y++) {
-    int filerow = y + E.rowoff;
-    if(filerow >= E.numrows) {
-      if (E.numrows == 0 && y == E.screenrows / 3) {
-        char welcome[80];
-        int welcomelen = snprintf(welcome, sizeof(welcome),
-                                "Kilo editor -- version %s", KILO_VERSION);
-        if (welcomelen > E.screencols)
-          welcomelen = E.screencols;
-        int padding = (E.screencols - welcomelen) / 2;
-        if (padding) {
-          abAppend(ab, "~", 1);
-          padding--;
-        }
-        while (padding--)
-          abAppend(ab, " ", 1);
-        abAppend(ab, welcome, welcomelen);
-      } else {
-        abAppend(ab, "~", 1);
-      }
-    } else {
-      int len = E.row[filerow].size - E.coloff;
-      if(len < 0) len = 0;
-      if(len > E.screencols) len = E.screencols;
-      abAppend(ab, &E.row[filerow].chars[E.coloff], len);
-    }
+/*
+ * editorBufferDropCaches() - Evict a background buffer's derived data
+ *
+ * Frees the per-row highlight and checkpoint allocations, forgets every
+ * cached render string, and releases the render arena in one sweep. Row
+ * text is never touched: it lives in the mapping or the row arena, and
+ * undo records share it by reference. The rows rebuild their caches
+ * lazily the next time the buffer is drawn.
+ */
+void editorBufferDropCaches(struct editorBuffer *buf) {
+  for (int i = 0; i < buf->rowcap; i++) {
+    if (i >= buf->rowgap_start && i < buf->rowgap_end)
+      continue;
+    erow *row = &buf->row[i];
+    free(row->hl);
+    row->hl = NULL;
+    row->hl_valid = 0;
+    free(row->wck_rx);
+    row->wck_rx = NULL;
+    free(row->wck_st);
+    row->wck_st = NULL;
+    row->nwck = 0;
+    row->render = NULL;
+    row->rsize = 0;
+  }
+  arenaRelease(&buf->renderarena);
+}
 
-    abAppend(ab, "\x1b[K", 3);
-    if (y < E.screenrows - 1) {
-      abAppend(ab, "\r\n", 2);
+/*
+ * editorBufferSwitch() - Make another buffer current
+ *
+ * Instant by design: repoint B, stamp the LRU clock, force one repaint.
+ * Afterwards, if the background buffers' combined cache footprint is over
+ * budget, drop caches coldest-first until it is not.
+ */
+void editorBufferSwitch(int idx) {
+  if (idx < 0 || idx >= E.nbufs || E.bufs[idx] == B)
+    return;
+  E.curbuf = idx;
+  B = E.bufs[idx];
+  B->lastused = ++E.bufclock;
+  E.fullrepaint = 1;
+
+  size_t total = 0;
+  for (int i = 0; i < E.nbufs; i++)
+    if (E.bufs[i] != B)
+      total += editorBufferCacheBytes(E.bufs[i]);
+  while (total > KILO_BG_CACHE_BUDGET) {
+    struct editorBuffer *cold = NULL;
+    for (int i = 0; i < E.nbufs; i++) {
+      struct editorBuffer *buf = E.bufs[i];
+      if (buf == B || editorBufferCacheBytes(buf) == 0)
+        continue;
+      if (cold == NULL || buf->lastused < cold->lastused)
+        cold = buf;
     }
+    if (cold == NULL)
+      break;
+    total -= editorBufferCacheBytes(cold);
+    editorBufferDropCaches(cold);
   }
 }
 
+/*** row operations ***/
+
 /*
- * editorRefreshScreen() - Clear screen and redraw
+ * Gap-buffer row table
+ *
+ * The row table is no longer a densely packed array: B->row (and the lazy
+ * line-offset index, which must stay index-aligned with it) is one
+ * allocation of B->rowcap entries with a hole - the gap - between physical
+ * indices rowgap_start and rowgap_end. Logical row i lives at physical
+ * index i when it is left of the gap, or i + gap-length when right of it.
+ *
+ * Inserting or deleting rows at position p means sliding the gap to p (a
+ * memmove proportional to the distance from the *previous* edit point, not
+ * to the file size) and then just adjusting the gap bounds. Since edits
+ * cluster - a paste, a run of line deletions - the slide is usually tiny
+ * and row insertion is amortized O(1) even in the middle of a 10M-line
+ * file, where the old flat array paid an O(n) tail memmove every time.
+ * Lookup stays O(1), so editorRowAt() keeps its interface and the draw and
+ * cursor code don't know the gap exists.
+ */
+
+int editorRowPhys(int at) {
+  return (at < B->rowgap_start) ? at : at + (B->rowgap_end - B->rowgap_start);
+}
+
+/*
+ * editorGrowRowTable() - Geometric growth of the erow metadata array
+ *
+ * The row table used to be realloc'd once per append, which is O(n^2) data
+ * movement over a big file. With a capacity field on editorConfig we double
+ * instead, so n appends cost O(n) amortized and at most ~2x transient
+ * metadata overhead. Growth widens the gap in place: the entries after the
+ * gap are shifted to the end of the new allocation, keeping all logical
+ * indices stable. The line-offset index always shares the row table's
+ * capacity and gap position.
+ */
+void editorGrowRowTable(int mincap) {
+  if (B->rowcap >= mincap)
+    return;
+  int cap = B->rowcap ? B->rowcap : 64;
+  while (cap < mincap)
+    cap *= 2;
+
+  int tail = B->rowcap - B->rowgap_end;
+  B->row = realloc(B->row, sizeof(erow) * cap);
+  if (B->row == NULL)
+    die("realloc");
+  memmove(&B->row[cap - tail], &B->row[B->rowgap_end], sizeof(erow) * tail);
+  if (B->lineoff) {
+    B->lineoff = realloc(B->lineoff, sizeof(size_t) * cap);
+    if (B->lineoff == NULL)
+      die("realloc");
+    memmove(&B->lineoff[cap - tail], &B->lineoff[B->rowgap_end],
+            sizeof(size_t) * tail);
+  }
+  B->rowgap_end = cap - tail;
+  B->rowcap = cap;
+}
+
+/*
+ * editorMoveRowGap() - Slide the gap so it starts at logical index at
+ *
+ * Shifts only the entries between the gap and the target position, in both
+ * B->row and the line-offset index.
+ */
+void editorMoveRowGap(int at) {
+  int gaplen = B->rowgap_end - B->rowgap_start;
+  if (at == B->rowgap_start)
+    return;
+  if (at < B->rowgap_start) {
+    int n = B->rowgap_start - at;
+    memmove(&B->row[at + gaplen], &B->row[at], sizeof(erow) * n);
+    if (B->lineoff)
+      memmove(&B->lineoff[at + gaplen], &B->lineoff[at], sizeof(size_t) * n);
+  } else {
+    int n = at - B->rowgap_start;
+    memmove(&B->row[B->rowgap_start], &B->row[B->rowgap_end], sizeof(erow) * n);
+    if (B->lineoff)
+      memmove(&B->lineoff[B->rowgap_start], &B->lineoff[B->rowgap_end],
+              sizeof(size_t) * n);
+  }
+  B->rowgap_start = at;
+  B->rowgap_end = at + gaplen;
+}
+
+/*
+ * editorOpenRowGap() - Insert n empty rows at logical index at
+ *
+ * After this returns, logical rows at..at+n-1 sit left of the gap (so their
+ * physical and logical indices coincide) and the caller must fill them with
+ * owned, non-NULL chars before they can be displayed.
+ */
+void editorOpenRowGap(int at, int n) {
+  editorGrowRowTable(B->numrows + n);
+  editorMoveRowGap(at);
+  B->rowgap_start += n;
+  B->numrows += n;
+  B->bufedited = 1;
+  B->matchdirty = 1;
+  B->vtree_dirty = 1;
+}
+
+/*
+ * editorDeleteRows() - Remove n rows starting at logical index at
+ *
+ * Deletion is just gap absorption: slide the gap to at and widen it over
+ * the doomed entries. Row text is arena- or mmap-backed, so there is
+ * nothing to free per row.
+ */
+void editorDeleteRows(int at, int n) {
+  if (at < 0 || n <= 0 || at + n > B->numrows)
+    return;
+  editorMoveRowGap(at);
+  B->rowgap_end += n;
+  B->numrows -= n;
+  B->bufedited = 1;
+  B->matchdirty = 1;
+  B->vtree_dirty = 1;
+}
+
+/*
+ * editorFillRow() - Initialize a freshly opened row with a copy of s
+ *
+ * The caller has already opened a gap slot at logical index at (which
+ * therefore sits left of the gap, so physical and logical indices
+ * coincide). The text is copied into the row arena and every cache field
+ * starts invalid, to be rebuilt lazily when the row is first drawn.
+ */
+void editorFillRow(int at, const char *s, size_t len) {
+  erow *row = &B->row[at];
+  row->size = len;
+  row->chars = arenaAlloc(&B->rowarena, len + 1);
+  if (row->chars == NULL)
+    die("arenaAlloc");
+  memcpy(row->chars, s, len);
+  row->chars[len] = '\0';
+  row->owned = 1;
+  row->render = NULL;
+  row->rsize = 0;
+  row->wck_rx = NULL;
+  row->wck_st = NULL;
+  row->nwck = 0;
+  row->hl = NULL;
+  row->hl_valid = 0;
+  row->hl_oc_end = 0;
+  row->vrows = 0;
+  row->vgen = 0;
+}
+
+/*
+ * editorRowAt() - Row lookup with lazy materialization
+ *
+ * All code that used to index B->row[] directly goes through this accessor.
+ * For a mapped file, editorOpenMapped() only builds the line-offset index up
+ * front; the erow entries start out zeroed (chars == NULL) and are filled in
+ * here the first time the draw loop or cursor movement actually touches a
+ * row. That keeps time-to-first-paint proportional to the viewport, not the
+ * file: jumping to the last page of a 5 GB log only materializes one
+ * screenful of rows.
+ *
+ * Mapped rows are NOT NUL-terminated (the next line of the file follows
+ * immediately), so anything touching row text must respect size rather than
+ * use str* calls.
+ *
+ * Returns: pointer to the (materialized) row, or NULL if at is out of range
+ */
+/*
+ * editorRowLen() - Size-only row accessor
+ *
+ * The struct-of-arrays half of the row table: row lengths are derivable
+ * from the dense, gap-aligned line-offset array without ever touching the
+ * pointer-laden erow structs, so scans that only need sizes - cursor
+ * clamping, page jumps - stream through B->lineoff instead of
+ * materializing a row per step. Rows that are already materialized (or
+ * were created by edits and have no offset entry) answer from the struct.
+ */
+int editorRowLen(int at) {
+  if (at < 0 || at >= B->numrows)
+    return 0;
+  erow *row = &B->row[editorRowPhys(at)];
+  if (row->chars != NULL || B->lineoff == NULL)
+    return row->size;
+  size_t start = B->lineoff[editorRowPhys(at)];
+  size_t end =
+      (at + 1 < B->numrows) ? B->lineoff[editorRowPhys(at + 1)] : B->filemap_len;
+  size_t len = end - start;
+  char *s = B->filemap + start;
+  while (len > 0 && (s[len - 1] == '\n' || s[len - 1] == '\r'))
+    len--;
+  return (int)len;
+}
+
+erow *editorRowAt(int at) {
+  if (at < 0 || at >= B->numrows)
+    return NULL;
+  erow *row = &B->row[editorRowPhys(at)];
+  if (row->chars == NULL && B->lineoff) {
+    int len = editorRowLen(at);
+    row->chars = B->filemap + B->lineoff[editorRowPhys(at)];
+    row->size = len;
+    row->owned = 0;
+    S.rows_materialized++;
+  }
+  return row;
+}
+
+/*
+ * editorRowEnsureOwned() - Copy-on-write for mapped rows
+ *
+ * Any future code path that wants to modify or free a row's text must call
+ * this first. For a row still borrowing the mmap it takes a private,
+ * NUL-terminated heap copy; rows that already own their memory are untouched.
+ * This keeps the cost of opening a huge file at zero copies, and we only pay
+ * per line the user actually edits.
+ */
+void editorRowEnsureOwned(erow *row) {
+  if (row->owned)
+    return;
+  char *copy = arenaAlloc(&B->rowarena, row->size + 1);
+  if (copy == NULL)
+    die("arenaAlloc");
+  memcpy(copy, row->chars, row->size);
+  copy[row->size] = '\0';
+  row->chars = copy;
+  row->owned = 1;
+  B->bufedited = 1;
+}
+
+/*
+ * editorUpdateRow() - Build a row's cached render string
+ *
+ * Expands tabs to the next KILO_TAB_STOP boundary and turns control bytes
+ * into a printable ^X pair (DEL becomes ^?). The result is carved from the
+ * render arena and cached on the row; invalidating a row just NULLs the
+ * pointer and lets the next draw rebuild it. Only rows that actually reach
+ * the screen are ever expanded.
+ */
+void editorUpdateRow(erow *row) {
+  int tabs = 0;
+  int ctrls = 0;
+  for (int j = 0; j < row->size; j++) {
+    if (row->chars[j] == '\t')
+      tabs++;
+    else if ((unsigned char)row->chars[j] < 32 || row->chars[j] == 127)
+      ctrls++;
+  }
+
+  row->render =
+      arenaAlloc(&B->renderarena, row->size + tabs * (KILO_TAB_STOP - 1) +
+                                     ctrls + 1);
+  if (row->render == NULL)
+    die("arenaAlloc");
+
+  int idx = 0;
+  for (int j = 0; j < row->size; j++) {
+    char c = row->chars[j];
+    if (c == '\t') {
+      row->render[idx++] = ' ';
+      while (idx % KILO_TAB_STOP != 0)
+        row->render[idx++] = ' ';
+    } else if ((unsigned char)c < 32 || c == 127) {
+      row->render[idx++] = '^';
+      row->render[idx++] = (c == 127) ? '?' : ('@' + c);
+    } else {
+      row->render[idx++] = c;
+    }
+  }
+  row->render[idx] = '\0';
+  row->rsize = idx;
+}
+
+/*
+ * editorByteWidth() - Display width of the source byte at index j
+ *
+ * The width rules in one place, shared by conversion and the checkpoint
+ * builder: tabs pad to the next stop, control bytes render as ^X (two
+ * columns), UTF-8 continuation bytes contribute nothing (the lead byte
+ * carries the character's single column - double-width CJK is not
+ * handled), everything else is one column.
+ */
+int editorByteWidth(erow *row, int j, int rx) {
+  unsigned char c = row->chars[j];
+  if (c == '\t')
+    return (KILO_TAB_STOP - 1) - (rx % KILO_TAB_STOP) + 1;
+  if (c < 32 || c == 127)
+    return 2;
+  if ((c & 0xC0) == 0x80)
+    return 0;
+  return 1;
+}
+
+/*
+ * editorRowBuildWidthIndex() - Lazily build a row's width checkpoints
+ *
+ * One pass over the row recording the display column at every
+ * KILO_WIDTH_CKPT'th byte. Only worth the memory for rows long enough
+ * that repeated linear conversion would hurt - a megabyte-long minified
+ * JSON line gets ~4K checkpoints and O(1) cursor mapping; short rows just
+ * scan.
+ */
+void editorRowBuildWidthIndex(erow *row) {
+  row->nwck = row->size / KILO_WIDTH_CKPT + 1;
+  row->wck_rx = malloc(sizeof(int) * row->nwck);
+  if (row->wck_rx == NULL)
+    die("malloc");
+  int rx = 0;
+  int k = 0;
+  for (int j = 0; j < row->size; j++) {
+    if (j % KILO_WIDTH_CKPT == 0)
+      row->wck_rx[k++] = rx;
+    rx += editorByteWidth(row, j, rx);
+  }
+  while (k < row->nwck)
+    row->wck_rx[k++] = rx;
+
+  // when a syntax is active, run a string/comment state tracker over the
+  // same pass structure and record the state at each checkpoint. This is
+  // not the full lexer - just the states that persist across bytes - and
+  // it lets a viewport slice be highlighted from the nearest checkpoint
+  // instead of from byte zero. A delimiter that happens to straddle a
+  // checkpoint can shift the recorded state by a byte or two; the cost is
+  // a cosmetic mis-color at the slice edge, never a crash.
+  if (B->syntax == NULL)
+    return;
+  row->wck_st = malloc(row->nwck);
+  if (row->wck_st == NULL)
+    die("malloc");
+  char *scs = B->syntax->singleline_comment_start;
+  char *mcs = B->syntax->multiline_comment_start;
+  char *mce = B->syntax->multiline_comment_end;
+  int scs_len = scs ? strlen(scs) : 0;
+  int mcs_len = mcs ? strlen(mcs) : 0;
+  int mce_len = mce ? strlen(mce) : 0;
+  int st = LEX_NORMAL;
+  int esc = 0;
+  int skip = 0;
+  k = 0;
+  for (int j = 0; j < row->size; j++) {
+    if (j % KILO_WIDTH_CKPT == 0)
+      row->wck_st[k++] = (unsigned char)st;
+    if (skip) {
+      skip--;
+      continue;
+    }
+    char c = row->chars[j];
+    if (st == LEX_LINECOMMENT)
+      continue;
+    if (st == LEX_MLCOMMENT) {
+      if (mce_len && row->size - j >= mce_len &&
+          !memcmp(&row->chars[j], mce, mce_len)) {
+        st = LEX_NORMAL;
+        skip = mce_len - 1;
+      }
+    } else if (st != LEX_NORMAL) {
+      if (esc)
+        esc = 0;
+      else if (c == '\\')
+        esc = 1;
+      else if (c == st)
+        st = LEX_NORMAL;
+    } else {
+      if (scs_len && row->size - j >= scs_len &&
+          !memcmp(&row->chars[j], scs, scs_len)) {
+        st = LEX_LINECOMMENT;
+      } else if (mcs_len && mce_len && row->size - j >= mcs_len &&
+                 !memcmp(&row->chars[j], mcs, mcs_len)) {
+        st = LEX_MLCOMMENT;
+        skip = mcs_len - 1;
+      } else if ((B->syntax->flags & HL_HIGHLIGHT_STRINGS) &&
+                 (c == '"' || c == '\'')) {
+        st = c;
+      }
+    }
+  }
+  while (k < row->nwck)
+    row->wck_st[k++] = (unsigned char)st;
+}
+
+/*
+ * editorRowCxToRx() - Convert a chars index to a display column
+ *
+ * For long rows, starts from the nearest width checkpoint instead of byte
+ * zero, so conversion cost is bounded by the checkpoint stride no matter
+ * how long the line is.
+ */
+int editorRowCxToRx(erow *row, int cx) {
+  int j = 0;
+  int rx = 0;
+  if (cx > row->size)
+    cx = row->size;
+  if (row->size >= 2 * KILO_WIDTH_CKPT) {
+    if (row->wck_rx == NULL)
+      editorRowBuildWidthIndex(row);
+    int k = cx / KILO_WIDTH_CKPT;
+    j = k * KILO_WIDTH_CKPT;
+    rx = row->wck_rx[k];
+  }
+  for (; j < cx; j++)
+    rx += editorByteWidth(row, j, rx);
+  return rx;
+}
+
+/*
+ * editorRowRxToCx() - Convert a display column back to a chars index
+ *
+ * Binary-searches the checkpoint table for the right stride, then scans
+ * at most KILO_WIDTH_CKPT bytes. The inverse mapping the viewport slicer
+ * and END-of-line logic need on huge single-line files.
+ */
+int editorRowRxToCx(erow *row, int rx) {
+  int j = 0;
+  int cur = 0;
+  if (row->size >= 2 * KILO_WIDTH_CKPT) {
+    if (row->wck_rx == NULL)
+      editorRowBuildWidthIndex(row);
+    int lo = 0, hi = row->nwck - 1;
+    while (lo < hi) {
+      int mid = lo + (hi - lo + 1) / 2;
+      if (row->wck_rx[mid] <= rx)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+    j = lo * KILO_WIDTH_CKPT;
+    cur = row->wck_rx[lo];
+  }
+  for (; j < row->size; j++) {
+    int w = editorByteWidth(row, j, cur);
+    if (cur + w > rx)
+      return j;
+    cur += w;
+  }
+  return row->size;
+}
+
+// rows at or above this size are "long rows": they never get monolithic
+// render or highlight caches, and every operation on them is kept local to
+// the KILO_WIDTH_CKPT-sized chunk in view
+#define KILO_LONG_ROW (1 << 16)
+
+int editorRowIsLong(erow *row) { return row->size >= KILO_LONG_ROW; }
+
+/*
+ * editorRowSliceRender() - Expand only the visible chunk of a long row
+ *
+ * A megabyte-long minified line must not cost a megabyte-plus render
+ * allocation (and a full tab-expansion walk) just to show 200 columns of
+ * it. The row's text stays one contiguous borrowed span - it lives in the
+ * mmap and cannot be re-chained - but the width-checkpoint index already
+ * divides it into fixed-size chunks, so we use that: locate the byte range
+ * covering display columns [rx0, rx0+cols) with a checkpoint lookup, then
+ * expand just those bytes into the caller's buffer. Horizontal scrolling
+ * at coloff 2,000,000 touches only the chunk in view.
+ *
+ * A tab or ^X pair can straddle the left edge; its visible tail is padded
+ * with spaces so column alignment holds.
+ */
+void editorRowSliceRender(erow *row, int rx0, int cols, struct abuf *out) {
+  int j = editorRowRxToCx(row, rx0);
+  int rx = editorRowCxToRx(row, j);
+  int end = rx0 + cols;
+
+  while (j < row->size && rx < end) {
+    int w = editorByteWidth(row, j, rx);
+    char c = row->chars[j];
+    if (rx < rx0) {
+      // partially visible leading byte: emit its tail as spaces
+      for (int k = rx + w; k > rx0 && k <= end; k--)
+        abAppend(out, " ", 1);
+    } else if (c == '\t') {
+      for (int k = 0; k < w && rx + k < end; k++)
+        abAppend(out, " ", 1);
+    } else if ((unsigned char)c < 32 || c == 127) {
+      abAppend(out, "^", 1);
+      if (rx + 1 < end) {
+        char p = (c == 127) ? '?' : ('@' + c);
+        abAppend(out, &p, 1);
+      }
+    } else {
+      // UTF-8 continuation bytes ride along at zero width
+      abAppend(out, &c, 1);
+    }
+    rx += w;
+    j++;
+  }
+}
+
+/*
+ * editorRowNextChar() / editorRowPrevChar() - Step over whole characters
+ *
+ * Cursor movement works in chars indices but must never land inside a
+ * UTF-8 sequence; these skip continuation bytes in either direction.
+ */
+int editorRowNextChar(erow *row, int cx) {
+  cx++;
+  while (cx < row->size && ((unsigned char)row->chars[cx] & 0xC0) == 0x80)
+    cx++;
+  return cx;
+}
+
+int editorRowPrevChar(erow *row, int cx) {
+  cx--;
+  while (cx > 0 && ((unsigned char)row->chars[cx] & 0xC0) == 0x80)
+    cx--;
+  return cx;
+}
+
+/*
+ * Soft word wrap
+ *
+ * Wrap mode (Ctrl-W, per buffer) folds long lines at the screen edge
+ * instead of scrolling them off it. The screen then shows *visual* lines -
+ * a logical row occupies ceil(width / screencols) of them - and scrolling
+ * and cursor placement need to translate between the two coordinate
+ * spaces. Measuring every row up front (or again on every resize) would
+ * touch the whole file, so the mapping is cached and refined lazily:
+ *
+ *   - each row caches its visual-line count (vrows), tagged with the
+ *     buffer's wrap generation; bumping the generation on a width change
+ *     invalidates every cached count in O(1)
+ *   - a Fenwick tree over the counts answers "visual lines above row i"
+ *     and its inverse in O(log n). A row never measured counts as one
+ *     visual line; the first time it is measured (drawing a screenful
+ *     measures exactly the rows in view) the tree is nudged by the
+ *     difference, so the mapping sharpens as you scroll through the file
+ *   - row insertion and deletion mark the tree dirty; the rebuild is one
+ *     O(n) pass over cached counts and never touches row text
+ *
+ * Toggling wrap on a million-line file therefore costs one all-ones tree
+ * fill and nothing per row, and stays O(log n) per frame afterwards.
+ */
+
+// Fenwick point update: add delta to logical row at's visual-line count
+void editorWrapTreeAdd(int at, long delta) {
+  for (int i = at + 1; i <= B->vtreen; i += i & -i)
+    B->vtree[i] += delta;
+}
+
+// visual lines above logical row at (the prefix sum over rows 0..at-1)
+long editorWrapVline(int at) {
+  long sum = 0;
+  if (at > B->vtreen)
+    at = B->vtreen;
+  for (int i = at; i > 0; i -= i & -i)
+    sum += B->vtree[i];
+  return sum;
+}
+
+// the logical row containing visual line v, with *sub set to which of the
+// row's visual lines it is; the classic Fenwick binary descent, O(log n)
+int editorWrapFind(long v, int *sub) {
+  int pos = 0;
+  int bit = 1;
+  while (bit * 2 <= B->vtreen)
+    bit *= 2;
+  for (; bit; bit /= 2)
+    if (pos + bit <= B->vtreen && B->vtree[pos + bit] <= v) {
+      pos += bit;
+      v -= B->vtree[pos];
+    }
+  *sub = (int)v;
+  return pos;
+}
+
+// reset the tree to the all-ones shape. Node i covers i & -i leaves, so
+// the all-ones tree has a closed form and no row needs measuring.
+void editorWrapTreeReset() {
+  B->vtreen = B->numrows;
+  B->vtree = realloc(B->vtree, sizeof(long) * (B->vtreen + 1));
+  if (B->vtree == NULL)
+    die("realloc");
+  for (int i = 1; i <= B->vtreen; i++)
+    B->vtree[i] = i & -i;
+  B->vtree_dirty = 0;
+}
+
+// rebuild from the cached counts after rows came or went: one pass over
+// erow metadata plus the O(n) Fenwick construction, no text touched
+void editorWrapTreeBuild() {
+  B->vtreen = B->numrows;
+  B->vtree = realloc(B->vtree, sizeof(long) * (B->vtreen + 1));
+  if (B->vtree == NULL)
+    die("realloc");
+  for (int i = 1; i <= B->vtreen; i++) {
+    erow *row = &B->row[editorRowPhys(i - 1)];
+    B->vtree[i] = (row->vgen == B->wrapgen && row->vrows) ? row->vrows : 1;
+  }
+  for (int i = 1; i <= B->vtreen; i++) {
+    int j = i + (i & -i);
+    if (j <= B->vtreen)
+      B->vtree[j] += B->vtree[i];
+  }
+  B->vtree_dirty = 0;
+}
+
+/*
+ * editorRowVrows() - Measure (and cache) one row's visual-line count
+ *
+ * Width comes from editorRowCxToRx(), so even a megabyte-long row is one
+ * checkpoint lookup, not a scan from byte zero. An unmeasured row rides
+ * in the tree as one visual line; the point update here keeps the tree
+ * exact from the moment the row is measured.
+ */
+int editorRowVrows(int at) {
+  erow *row = editorRowAt(at);
+  if (row->vgen == B->wrapgen && row->vrows)
+    return row->vrows;
+  int width = editorRowCxToRx(row, row->size);
+  int nv = width ? (width + B->wrapcols - 1) / B->wrapcols : 1;
+  row->vrows = nv;
+  row->vgen = B->wrapgen;
+  if (!B->vtree_dirty)
+    editorWrapTreeAdd(at, nv - 1);
+  return nv;
+}
+
+/*
+ * editorWrapSync() - Bring the wrap cache up to date before scrolling
+ *
+ * A width change (resize, or first use) bumps the generation - staling
+ * every cached count without visiting a single row - and resets the tree;
+ * structural edits just trigger the O(n) rebuild from whatever counts
+ * survived.
+ */
+void editorWrapSync() {
+  if (B->wrapcols != E.screencols) {
+    B->wrapcols = E.screencols;
+    B->wrapgen++;
+    editorWrapTreeReset();
+  } else if (B->vtree_dirty || B->vtreen != B->numrows) {
+    editorWrapTreeBuild();
+  }
+}
+
+/*** undo ***/
+
+/*
+ * editorCaptureRows() - Share n rows' metadata into a delta
+ *
+ * Rows must be materialized first: once a row leaves the table its index no
+ * longer lines up with the lazy offset index, so an unmaterialized entry
+ * would be unresolvable later. The text itself is shared, not copied.
+ */
+erow *editorCaptureRows(int at, int n) {
+  erow *rows = malloc(sizeof(erow) * n);
+  if (rows == NULL)
+    die("malloc");
+  for (int i = 0; i < n; i++) {
+    rows[i] = *editorRowAt(at + i);
+    // don't alias the live row's render/highlight caches; the restored row
+    // will rebuild them lazily when drawn
+    rows[i].render = NULL;
+    rows[i].rsize = 0;
+    rows[i].wck_rx = NULL;
+    rows[i].wck_st = NULL;
+    rows[i].nwck = 0;
+    rows[i].hl = NULL;
+    rows[i].hl_valid = 0;
+    rows[i].vrows = 0;
+    rows[i].vgen = 0;
+  }
+  return rows;
+}
+
+/*
+ * editorRecordEdit() - Push a delta for an edit that just happened
+ *
+ * For EDIT_DELETE_ROWS the caller passes the captured rows (taken before
+ * the deletion); for EDIT_INSERT_ROWS rows is NULL until the insert is
+ * first undone. Any redoable tail above undopos is discarded, the same way
+ * every editor forgets the redo branch when you type after an undo.
+ */
+void editorRecordEdit(int op, int at, int n, erow *rows, int cx, int cy) {
+  for (int i = B->undopos; i < B->nundo; i++)
+    free(B->undo[i].rows);
+  B->nundo = B->undopos;
+
+  if (B->nundo == B->undocap) {
+    B->undocap = B->undocap ? B->undocap * 2 : 64;
+    B->undo = realloc(B->undo, sizeof(struct editDelta) * B->undocap);
+    if (B->undo == NULL)
+      die("realloc");
+  }
+  struct editDelta *d = &B->undo[B->nundo++];
+  d->op = op;
+  d->at = at;
+  d->n = n;
+  d->rows = rows;
+  d->cx = cx;
+  d->cy = cy;
+  B->undopos = B->nundo;
+}
+
+/*
+ * editorUndo() / editorRedo() - Walk the delta stack
+ *
+ * Undoing an insert captures the inserted rows into the delta (so redo can
+ * splice the very same spans back) and deletes them; undoing a delete
+ * splices the shared rows back into the table. Redo is the mirror image.
+ * Either direction is O(n) in rows touched by the delta and O(1) in text.
+ */
+void editorUndo() {
+  if (B->undopos == 0)
+    return;
+  struct editDelta *d = &B->undo[--B->undopos];
+  if (d->op == EDIT_INSERT_ROWS) {
+    if (d->rows == NULL)
+      d->rows = editorCaptureRows(d->at, d->n);
+    editorDeleteRows(d->at, d->n);
+  } else {
+    editorOpenRowGap(d->at, d->n);
+    for (int i = 0; i < d->n; i++)
+      B->row[d->at + i] = d->rows[i];
+  }
+  B->cx = d->cx;
+  B->cy = d->cy;
+  if (B->cy > B->numrows)
+    B->cy = B->numrows;
+}
+
+void editorRedo() {
+  if (B->undopos == B->nundo)
+    return;
+  struct editDelta *d = &B->undo[B->undopos++];
+  if (d->op == EDIT_INSERT_ROWS) {
+    editorOpenRowGap(d->at, d->n);
+    for (int i = 0; i < d->n; i++)
+      B->row[d->at + i] = d->rows[i];
+  } else {
+    editorDeleteRows(d->at, d->n);
+  }
+  B->cy = d->at;
+  if (B->cy > B->numrows)
+    B->cy = B->numrows;
+  B->cx = 0;
+}
+
+/*** file i/o ***/
+
+// granularity of the fallback read loop in editorOpenBuffered(); one syscall
+// per megabyte keeps us I/O-bound instead of syscall-bound.
+#define KILO_READ_CHUNK (1 << 20)
+
+// below this size the thread fan-out costs more than the scan itself
+#define KILO_PARALLEL_INDEX_MIN (1 << 22)
+
+// one worker's slice of the parallel index: scan [start, end) of base and
+// record the offset just past every newline (they are the line starts that
+// "belong" to this slice; offset 0 is added globally at merge time)
+struct indexRange {
+  char *base;
+  size_t start, end;
+  size_t limit; // global buffer length; a line start at EOF is not a line
+  size_t *offs;
+  int n, cap;
+};
+
+void indexRangeScan(void *arg) {
+  struct indexRange *r = arg;
+  char *p = r->base + r->start;
+  char *end = r->base + r->end;
+  while (p < end) {
+    char *nl = memchr(p, '\n', end - p);
+    if (nl == NULL)
+      break;
+    size_t off = (nl - r->base) + 1;
+    if (off < r->limit) {
+      if (r->n == r->cap) {
+        r->cap = r->cap ? r->cap * 2 : 4096;
+        r->offs = realloc(r->offs, sizeof(size_t) * r->cap);
+        if (r->offs == NULL)
+          die("realloc");
+      }
+      r->offs[r->n++] = off;
+    }
+    p = nl + 1;
+  }
+}
+
+/*
+ * editorIndexLines() - Bulk newline indexer
+ *
+ * Fills B->lineoff with the start offset of every line, then callocs the
+ * (lazily materialized) erow table. The boundary search is delegated to
+ * memchr(): glibc's memchr is vectorized (SSE2/AVX2 on x86), which gets us
+ * multiple GB/s of indexing throughput per core without writing any
+ * intrinsics ourselves - and stays portable C99 on every other platform.
+ *
+ * Buffers past KILO_PARALLEL_INDEX_MIN are fanned out over the worker
+ * pool: the byte range is split into one contiguous slice per worker, each
+ * slice records the line starts following its own newlines (every newline
+ * byte belongs to exactly one slice, so there are no duplicates and no
+ * alignment fixups), and the per-slice vectors - already sorted - are
+ * concatenated after offset 0. Indexing scales with core count while the
+ * input thread just waits.
+ *
+ * The index is rebuilt from scratch here, so callers must only invoke it
+ * once per loaded buffer.
+ */
+void editorIndexLines(void) {
+  int nlines = 0;
+  int linecap = 0;
+
+  if (B->filemap_len >= KILO_PARALLEL_INDEX_MIN && E.pool.nthreads > 1) {
+    int njobs = E.pool.nthreads;
+    struct indexRange *ranges = calloc(njobs, sizeof(struct indexRange));
+    if (ranges == NULL)
+      die("calloc");
+    size_t chunk = B->filemap_len / njobs;
+    for (int i = 0; i < njobs; i++) {
+      ranges[i].base = B->filemap;
+      ranges[i].start = chunk * i;
+      ranges[i].end = (i == njobs - 1) ? B->filemap_len : chunk * (i + 1);
+      ranges[i].limit = B->filemap_len;
+      poolSubmit(indexRangeScan, NULL, &ranges[i]);
+    }
+    poolWait();
+
+    nlines = 1; // line 0 starts at offset 0
+    for (int i = 0; i < njobs; i++)
+      nlines += ranges[i].n;
+    linecap = nlines;
+    B->lineoff = realloc(B->lineoff, sizeof(size_t) * linecap);
+    if (B->lineoff == NULL)
+      die("realloc");
+    B->lineoff[0] = 0;
+    int at = 1;
+    for (int i = 0; i < njobs; i++) {
+      memcpy(&B->lineoff[at], ranges[i].offs, sizeof(size_t) * ranges[i].n);
+      at += ranges[i].n;
+      free(ranges[i].offs);
+    }
+    free(ranges);
+  } else {
+    char *p = B->filemap;
+    char *end = B->filemap + B->filemap_len;
+    while (p < end) {
+      if (nlines == linecap) {
+        linecap = linecap ? linecap * 2 : 4096;
+        B->lineoff = realloc(B->lineoff, sizeof(size_t) * linecap);
+        if (B->lineoff == NULL)
+          die("realloc");
+      }
+      B->lineoff[nlines++] = p - B->filemap;
+      char *nl = memchr(p, '\n', end - p);
+      p = nl ? nl + 1 : end;
+    }
+  }
+
+  B->numrows = nlines;
+  // the erow table shares the offset index's capacity and starts with its
+  // gap at the end (i.e. it is densely packed)
+  B->rowcap = linecap ? linecap : 1;
+  B->rowgap_start = nlines;
+  B->rowgap_end = B->rowcap;
+  B->row = calloc(B->rowcap, sizeof(erow));
+  if (B->row == NULL)
+    die("calloc");
+}
+
+/*
+ * editorOpenMapped() - mmap-backed loading path
+ *
+ * For a regular file we can skip the read-everything-through-stdio approach
+ * entirely: map the whole file read-only with mmap(), then do a single scan
+ * for newlines. Opening a 5 GB log costs one mmap plus the newline scan
+ * instead of millions of heap allocations, and resident memory stays at one
+ * copy (the page cache).
+ *
+ * The scan fills only B->lineoff - one size_t per line, recording where each
+ * line starts in the mapping. The erow table itself is calloc'd and left
+ * empty; editorRowAt() materializes entries on demand. calloc of the erow
+ * table is lazy (untouched pages stay zero), so opening cost is dominated by
+ * the index, not the row count.
+ *
+ * MAP_PRIVATE is fine since we never write through the mapping; edits go
+ * through editorRowEnsureOwned() instead. The fd can be closed right after
+ * mmap() - the mapping keeps its own reference.
+ *
+ * Returns: 0 on success, -1 if the file can't be mapped (caller falls back)
+ */
+int editorOpenMapped(char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    return -1;
+
+  struct stat sb;
+  if (fstat(fd, &sb) == -1 || !S_ISREG(sb.st_mode) || sb.st_size == 0) {
+    close(fd);
+    return -1;
+  }
+
+  char *map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return -1;
+
+  B->filemap = map;
+  B->filemap_len = sb.st_size;
+  B->filemap_mmapped = 1;
+
+  editorIndexLines();
+  return 0;
+}
+
+/*
+ * editorOpenBuffered() - Chunked-read fallback for unmappable files
+ *
+ * Replaces the old getline() loop: instead of one stdio call (and one
+ * malloc) per line, we slurp the whole file into a single geometrically
+ * grown buffer with megabyte-sized read() calls, then hand it to the same
+ * bulk indexer the mmap path uses. Rows borrow from this buffer exactly as
+ * they borrow from a mapping, so the per-line copy is gone from this path
+ * too.
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+int editorOpenBuffered(char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    return -1;
+
+  size_t cap = KILO_READ_CHUNK;
+  size_t len = 0;
+  char *buf = malloc(cap);
+  if (buf == NULL)
+    die("malloc");
+
+  ssize_t n;
+  while ((n = read(fd, buf + len, cap - len)) > 0) {
+    len += n;
+    if (len == cap) {
+      cap *= 2;
+      buf = realloc(buf, cap);
+      if (buf == NULL)
+        die("realloc");
+    }
+  }
+  close(fd);
+  if (n == -1) {
+    free(buf);
+    return -1;
+  }
+
+  B->filemap = buf;
+  B->filemap_len = len;
+  B->filemap_mmapped = 0;
+
+  editorIndexLines();
+  return 0;
+}
+
+void editorOpen(char *filename) {
+  free(B->filename);
+  B->filename = strdup(filename);
+  editorSelectSyntaxHighlight();
+
+  if (editorOpenMapped(filename) == 0)
+    return;
+  if (editorOpenBuffered(filename) == 0)
+    return;
+  die("open");
+}
+
+// number of iovec entries per writev() batch. Linux caps a single writev at
+// IOV_MAX (1024) entries; 512 keeps us comfortably under it while still
+// flushing 256 rows (chars + newline) per syscall.
+#define KILO_SAVE_IOV 512
+
+/*
+ * editorWriteAll() - Flush an iovec batch, handling short writes
+ *
+ * writev() may write fewer bytes than asked; advance through the vector
+ * until everything is on its way to the file.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int editorWriteAll(int fd, struct iovec *iov, int cnt) {
+  while (cnt > 0) {
+    ssize_t n = writev(fd, iov, cnt);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    while (cnt > 0 && n >= (ssize_t)iov[0].iov_len) {
+      n -= iov[0].iov_len;
+      iov++;
+      cnt--;
+    }
+    if (cnt > 0) {
+      iov[0].iov_base = (char *)iov[0].iov_base + n;
+      iov[0].iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+/*
+ * editorSave() - Write the buffer out atomically, with zero copies
+ *
+ * Two properties matter here:
+ *
+ * Zero-copy: instead of concatenating rows into a staging buffer (or one
+ * write() per row), we build iovec batches that point directly at each
+ * row's chars - whether that memory is the mmap of the original file or the
+ * arena - plus a shared one-byte newline, and hand them to writev(). A 5 GB
+ * buffer streams to disk without ever being assembled in memory.
+ *
+ * Atomicity: output goes to a temp file in the same directory, fsync'd, and
+ * then rename()d over the original. A crash mid-save leaves either the old
+ * file or the new file, never a torn mixture. Note the mmap rows read from
+ * the *old* inode, which rename keeps alive until we're done with it.
+ *
+ * Returns: 0 on success, -1 on failure (original file untouched)
+ */
+int editorSave() {
+  if (B->filename == NULL)
+    return -1;
+
+  char tmppath[1024];
+  if (snprintf(tmppath, sizeof(tmppath), "%s.kilo-save.%d", B->filename,
+               (int)getpid()) >= (int)sizeof(tmppath))
+    return -1;
+
+  // carry over the original file's permissions when it exists
+  mode_t mode = 0644;
+  struct stat sb;
+  if (stat(B->filename, &sb) == 0)
+    mode = sb.st_mode & 07777;
+
+  int fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, mode);
+  if (fd == -1)
+    return -1;
+
+  static char nl = '\n';
+  struct iovec iov[KILO_SAVE_IOV];
+  int cnt = 0;
+  for (int at = 0; at < B->numrows; at++) {
+    erow *row = editorRowAt(at);
+    iov[cnt].iov_base = row->chars;
+    iov[cnt].iov_len = row->size;
+    cnt++;
+    iov[cnt].iov_base = &nl;
+    iov[cnt].iov_len = 1;
+    cnt++;
+    if (cnt == KILO_SAVE_IOV) {
+      if (editorWriteAll(fd, iov, cnt) == -1)
+        goto fail;
+      cnt = 0;
+    }
+  }
+  if (cnt > 0 && editorWriteAll(fd, iov, cnt) == -1)
+    goto fail;
+
+  if (fsync(fd) == -1)
+    goto fail;
+  if (close(fd) == -1) {
+    fd = -1;
+    goto fail;
+  }
+  fd = -1;
+  if (rename(tmppath, B->filename) == -1)
+    goto fail;
+  return 0;
+
+fail:
+  if (fd != -1)
+    close(fd);
+  unlink(tmppath);
+  return -1;
+}
+// malloc() comes from <stdlib.h>. ssize_t comes from <sys/types.h>.
+// FILE, fopen(), and getline() come from <stdio.h>.
+// editorOpen() now takes a filename and opens the file for reading using fopen().
+// We allow the user to choose a file to open by checking if they passed a filename as a
+// command line argument. If they did, we call editorOpen() and pass it the filename.
+// If they ran ./kilo with no arguments, editorOpen() will not be called and they’ll start with a blank file.
+
+/*
+ * editorFollowRefresh() - Pick up bytes appended to a followed file
+ *
+ * The incremental half of follow mode: instead of re-running editorOpen()
+ * on every append, remap the file at its new size and index only the
+ * bytes past the previous EOF. Appending 10 MB to a 5 GB log costs a
+ * 10 MB newline scan, one gap-open at the end of the row table, and a
+ * partial redraw. The private mapping can land at a new address, so rows
+ * still borrowing the old one are rebased by offset first. New rows get
+ * only their line-offset entries; they materialize lazily like any other
+ * mapped row.
+ *
+ * The scan restarts one byte before the old EOF: a newline that used to
+ * be the file's last byte produced no row then, but starts one now.
+ */
+void editorFollowRefresh(struct editorBuffer *buf) {
+  if (!buf->follow || !buf->filemap_mmapped || buf->filename == NULL)
+    return;
+  struct stat st;
+  if (stat(buf->filename, &st) == -1 || (size_t)st.st_size <= buf->filemap_len)
+    return;
+  size_t oldlen = buf->filemap_len;
+  size_t newlen = st.st_size;
+
+  int fd = open(buf->filename, O_RDONLY);
+  if (fd == -1)
+    return;
+  char *newmap = mmap(NULL, newlen, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (newmap == MAP_FAILED)
+    return;
+
+  char *oldmap = buf->filemap;
+  for (int i = 0; i < buf->rowcap; i++) {
+    if (i >= buf->rowgap_start && i < buf->rowgap_end)
+      continue;
+    erow *row = &buf->row[i];
+    if (row->chars && !row->owned)
+      row->chars = newmap + (row->chars - oldmap);
+  }
+  // undo deltas share row text by reference, so captured rows (deleted
+  // lines, undone inserts) borrow the mapping exactly like live ones and
+  // must be rebased too, or undoing after a remap splices dangling
+  // pointers back into the table
+  for (int i = 0; i < buf->nundo; i++) {
+    erow *rows = buf->undo[i].rows;
+    if (rows == NULL)
+      continue;
+    for (int j = 0; j < buf->undo[i].n; j++)
+      if (rows[j].chars && !rows[j].owned)
+        rows[j].chars = newmap + (rows[j].chars - oldmap);
+  }
+  munmap(oldmap, oldlen);
+  buf->filemap = newmap;
+  buf->filemap_len = newlen;
+
+  // the row operations all act on the current buffer; follow events can
+  // arrive for background ones, so swap it in for the splice
+  struct editorBuffer *saved = B;
+  B = buf;
+
+  // the old last line may have grown a tail: let it re-materialize. Only
+  // valid while the row's text still spans its slot of the offset index
+  // all the way to the old EOF - after a deletion at the tail the index
+  // extent reaches past this row's real text, and re-deriving the length
+  // would resurrect the deleted bytes.
+  int oldrows = buf->numrows;
+  if (oldrows > 0) {
+    erow *row = &buf->row[editorRowPhys(oldrows - 1)];
+    size_t start = buf->lineoff[editorRowPhys(oldrows - 1)];
+    size_t ext = oldlen - start;
+    while (ext > 0 &&
+           (newmap[start + ext - 1] == '\n' || newmap[start + ext - 1] == '\r'))
+      ext--;
+    if (!row->owned && row->chars == newmap + start &&
+        (size_t)row->size == ext) {
+      free(row->hl);
+      free(row->wck_rx);
+      free(row->wck_st);
+      memset(row, 0, sizeof(erow));
+      // the row's width (and so its wrap count) may have grown in place
+      buf->vtree_dirty = 1;
+    }
+  }
+
+  char *lim = newmap + newlen;
+  char *p = newmap + (oldlen - 1);
+  int nnew = 0;
+  while ((p = memchr(p, '\n', lim - p)) != NULL) {
+    p++;
+    if (p >= lim)
+      break;
+    nnew++;
+  }
+  if (nnew > 0) {
+    int at = buf->numrows;
+    // a pure append keeps the buffer contiguous with the file, so the
+    // pristine-buffer fast paths (search memmem over the mapping) survive
+    int wasedited = buf->bufedited;
+    editorOpenRowGap(at, nnew);
+    buf->bufedited = wasedited;
+    p = newmap + (oldlen - 1);
+    int i = at;
+    while ((p = memchr(p, '\n', lim - p)) != NULL) {
+      p++;
+      if (p >= lim)
+        break;
+      memset(&buf->row[i], 0, sizeof(erow));
+      buf->lineoff[i] = p - newmap;
+      i++;
+    }
+    // auto-scroll only while the cursor is pinned past the old tail;
+    // scrolling up unpins it, like tail -f piped through a pager
+    if (buf->cy >= at) {
+      buf->cy = buf->numrows;
+      buf->cx = 0;
+    }
+  }
+
+  B = saved;
+}
+
+/*
+ * editorCheckFollow() - Drain inotify and refresh the buffers it names
+ *
+ * Called once per main-loop iteration; the fd is nonblocking, so with no
+ * events pending this is a single failed read. Repeat events for the same
+ * watch collapse: a refresh that finds the file no bigger does nothing.
+ */
+void editorCheckFollow() {
+  if (E.inotfd == -1)
+    return;
+  char evbuf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t n;
+  while ((n = read(E.inotfd, evbuf, sizeof(evbuf))) > 0) {
+    ssize_t off = 0;
+    while (off < n) {
+      struct inotify_event *ev = (struct inotify_event *)&evbuf[off];
+      for (int i = 0; i < E.nbufs; i++)
+        if (E.bufs[i]->wd == ev->wd)
+          editorFollowRefresh(E.bufs[i]);
+      off += sizeof(struct inotify_event) + ev->len;
+    }
+  }
+}
+
+/*
+ * editorToggleFollow() - tail -f for the current buffer
+ *
+ * Turning follow on registers an inotify watch, pins the cursor to the
+ * end of the buffer, and catches up on anything appended before the
+ * watch existed. Only mapped files can be followed - the buffered-read
+ * fallback has no stable bytes to extend.
+ */
+void editorToggleFollow() {
+  if (B->follow) {
+    if (E.inotfd != -1 && B->wd > 0)
+      inotify_rm_watch(E.inotfd, B->wd);
+    B->wd = 0;
+    B->follow = 0;
+    return;
+  }
+  if (E.inotfd == -1 || B->filename == NULL || !B->filemap_mmapped)
+    return;
+  int wd = inotify_add_watch(E.inotfd, B->filename, IN_MODIFY);
+  if (wd == -1)
+    return;
+  B->wd = wd;
+  B->follow = 1;
+  B->cy = B->numrows;
+  B->cx = 0;
+  editorFollowRefresh(B);
+}
+
+/*** syntax highlighting ***/
+
+char *C_HL_extensions[] = {".c", ".h", ".cpp", NULL};
+char *C_HL_keywords[] = {
+    "switch", "if",      "while",  "for",     "break",   "continue",
+    "return", "else",    "struct", "union",   "typedef", "static",
+    "enum",   "class",   "case",   "int|",    "long|",   "double|",
+    "float|", "char|",   "unsigned|", "signed|", "void|", "size_t|",
+    NULL};
+
+struct editorSyntax HLDB[] = {
+    {"c", C_HL_extensions, C_HL_keywords, "//", "/*", "*/",
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS},
+};
+
+#define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0]))
+
+int is_separator(int c) {
+  return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
+}
+
+/*
+ * editorLexSpan() - Lex one span of text into highlight classes
+ *
+ * The lexer core, separated from any particular row: classify `len` bytes
+ * of `text` into `hl`, starting from an explicit entry state (a lexState
+ * value) and an initial "previous byte was a separator" flag. Returns the
+ * exit state. Callers are a whole row (entry state from the row above)
+ * and a viewport slice of a long row (entry state from the nearest width
+ * checkpoint), which is why state is a parameter instead of implicit
+ * "start of line" assumptions. Assumes B->syntax is set.
+ */
+int editorLexSpan(const char *text, int len, unsigned char *hl, int state,
+                  int prev_sep) {
+  char **keywords = B->syntax->keywords;
+  char *scs = B->syntax->singleline_comment_start;
+  char *mcs = B->syntax->multiline_comment_start;
+  char *mce = B->syntax->multiline_comment_end;
+  int scs_len = scs ? strlen(scs) : 0;
+  int mcs_len = mcs ? strlen(mcs) : 0;
+  int mce_len = mce ? strlen(mce) : 0;
+
+  if (state == LEX_LINECOMMENT) {
+    memset(hl, HL_COMMENT, len);
+    return LEX_LINECOMMENT;
+  }
+  int in_comment = (state == LEX_MLCOMMENT);
+  int in_string = (state != LEX_NORMAL && !in_comment) ? state : 0;
+
+  int i = 0;
+  while (i < len) {
+    char c = text[i];
+    unsigned char prev_hl = (i > 0) ? hl[i - 1] : HL_NORMAL;
+
+    if (scs_len && !in_string && !in_comment) {
+      if (len - i >= scs_len && !memcmp(&text[i], scs, scs_len)) {
+        memset(&hl[i], HL_COMMENT, len - i);
+        return LEX_LINECOMMENT;
+      }
+    }
+
+    if (mcs_len && mce_len && !in_string) {
+      if (in_comment) {
+        hl[i] = HL_MLCOMMENT;
+        if (len - i >= mce_len && !memcmp(&text[i], mce, mce_len)) {
+          memset(&hl[i], HL_MLCOMMENT, mce_len);
+          i += mce_len;
+          in_comment = 0;
+          prev_sep = 1;
+          continue;
+        }
+        i++;
+        continue;
+      } else if (len - i >= mcs_len && !memcmp(&text[i], mcs, mcs_len)) {
+        memset(&hl[i], HL_MLCOMMENT, mcs_len);
+        i += mcs_len;
+        in_comment = 1;
+        continue;
+      }
+    }
+
+    if (B->syntax->flags & HL_HIGHLIGHT_STRINGS) {
+      if (in_string) {
+        hl[i] = HL_STRING;
+        if (c == '\\' && i + 1 < len) {
+          hl[i + 1] = HL_STRING;
+          i += 2;
+          continue;
+        }
+        if (c == in_string)
+          in_string = 0;
+        i++;
+        prev_sep = 1;
+        continue;
+      } else if (c == '"' || c == '\'') {
+        in_string = c;
+        hl[i] = HL_STRING;
+        i++;
+        continue;
+      }
+    }
+
+    if (B->syntax->flags & HL_HIGHLIGHT_NUMBERS) {
+      if ((isdigit((unsigned char)c) &&
+           (prev_sep || prev_hl == HL_NUMBER)) ||
+          (c == '.' && prev_hl == HL_NUMBER)) {
+        hl[i] = HL_NUMBER;
+        i++;
+        prev_sep = 0;
+        continue;
+      }
+    }
+
+    if (prev_sep) {
+      int j;
+      for (j = 0; keywords[j]; j++) {
+        int klen = strlen(keywords[j]);
+        int kw2 = keywords[j][klen - 1] == '|';
+        if (kw2)
+          klen--;
+        if (len - i >= klen && !memcmp(&text[i], keywords[j], klen) &&
+            (len - i == klen || is_separator(text[i + klen]))) {
+          memset(&hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
+          i += klen;
+          break;
+        }
+      }
+      if (keywords[j] != NULL) {
+        prev_sep = 0;
+        continue;
+      }
+    }
+
+    prev_sep = is_separator((unsigned char)c);
+    i++;
+  }
+
+  if (in_comment)
+    return LEX_MLCOMMENT;
+  if (in_string)
+    return in_string;
+  return LEX_NORMAL;
+}
+
+/*
+ * editorUpdateSyntax() - (Re)lex one row into its highlight cache
+ *
+ * Called lazily from editorDrawRows() the first time a row is displayed
+ * (or again after its cache is invalidated), never as a whole-file pass.
+ * The entry state comes from the row above's cached exit state when that
+ * row has been lexed, so lexing the viewport top-to-bottom threads
+ * multi-line comment state through it correctly. If this row's exit state
+ * changed, the row below's cache is marked stale - propagation is one
+ * lazy step at a time, so the cost of an edit is bounded by the rows that
+ * actually get drawn afterwards, not by the file.
+ */
+void editorUpdateSyntax(int at) {
+  erow *row = editorRowAt(at);
+  if (row->render == NULL)
+    editorUpdateRow(row);
+  row->hl = realloc(row->hl, row->rsize ? row->rsize : 1);
+  if (row->hl == NULL)
+    die("realloc");
+  memset(row->hl, HL_NORMAL, row->rsize);
+  row->hl_valid = 1;
+
+  if (B->syntax == NULL) {
+    if (row->hl_oc_end) {
+      row->hl_oc_end = 0;
+    }
+    return;
+  }
+
+  erow *prev = (at > 0) ? &B->row[editorRowPhys(at - 1)] : NULL;
+  int entry = (prev && prev->hl_valid && prev->hl_oc_end) ? LEX_MLCOMMENT
+                                                          : LEX_NORMAL;
+  int exit_state = editorLexSpan(row->render, row->rsize, row->hl, entry, 1);
+
+  int oc = (exit_state == LEX_MLCOMMENT);
+  int changed = (row->hl_oc_end != oc);
+  row->hl_oc_end = oc;
+  if (changed && at + 1 < B->numrows)
+    B->row[editorRowPhys(at + 1)].hl_valid = 0;
+}
+
+/*
+ * editorSyntaxToColor() - Map a highlight class to an ANSI color code
+ */
+int editorSyntaxToColor(int hl) {
+  switch (hl) {
+    case HL_COMMENT:
+    case HL_MLCOMMENT: return 36;
+    case HL_KEYWORD1: return 33;
+    case HL_KEYWORD2: return 32;
+    case HL_STRING: return 35;
+    case HL_NUMBER: return 31;
+    default: return 37;
+  }
+}
+
+/*
+ * editorRowSliceRenderHl() - Highlighted viewport slice of a long row
+ *
+ * The colored counterpart of editorRowSliceRender(): per-frame cost is
+ * O(screencols + checkpoint stride) no matter how long the line is. The
+ * slice is lexed from the width checkpoint just before the visible span,
+ * seeded with the lexer state recorded there, so the lexer never walks in
+ * from byte zero. The span's highlight classes land in a scratch buffer
+ * that grows once and is reused every frame; it never exceeds one
+ * checkpoint stride plus a screenful of bytes.
+ *
+ * Long rows lex raw chars rather than a render string (they have none);
+ * for string/comment/keyword purposes the two differ only in tab and
+ * control-byte expansion, which never changes those states.
+ */
+void editorRowSliceRenderHl(erow *row, int rx0, int cols, struct abuf *out) {
+  if (row->wck_rx == NULL)
+    editorRowBuildWidthIndex(row);
+  if (row->wck_st == NULL) {
+    // index was built before a syntax was active; draw plain
+    editorRowSliceRender(row, rx0, cols, out);
+    return;
+  }
+
+  int jstart = editorRowRxToCx(row, rx0);
+  int jend = editorRowRxToCx(row, rx0 + cols);
+  if (jend < row->size)
+    jend++; // the byte under the right edge starts inside the window
+  int k = jstart / KILO_WIDTH_CKPT;
+  int jck = k * KILO_WIDTH_CKPT;
+  int span = jend - jck;
+
+  static unsigned char *hlbuf = NULL;
+  static int hlcap = 0;
+  if (span > hlcap) {
+    hlcap = span;
+    hlbuf = realloc(hlbuf, hlcap);
+    if (hlbuf == NULL)
+      die("realloc");
+  }
+  memset(hlbuf, HL_NORMAL, span);
+  int ps = (jck == 0) ? 1 : is_separator((unsigned char)row->chars[jck - 1]);
+  editorLexSpan(&row->chars[jck], span, hlbuf, row->wck_st[k], ps);
+
+  int rx = editorRowCxToRx(row, jstart);
+  int end = rx0 + cols;
+  int current_color = -1;
+  for (int j = jstart; j < row->size && rx < end; j++) {
+    int w = editorByteWidth(row, j, rx);
+    char c = row->chars[j];
+    unsigned char h = hlbuf[j - jck];
+    int color = (h == HL_NORMAL) ? -1 : editorSyntaxToColor(h);
+    if (color != current_color) {
+      if (color == -1) {
+        abAppend(out, "\x1b[39m", 5);
+      } else {
+        char buf[16];
+        int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
+        abAppend(out, buf, clen);
+      }
+      current_color = color;
+    }
+    if (rx < rx0) {
+      // partially visible leading byte: emit its tail as spaces
+      for (int t = rx + w; t > rx0 && t <= end; t--)
+        abAppend(out, " ", 1);
+    } else if (c == '\t') {
+      for (int t = 0; t < w && rx + t < end; t++)
+        abAppend(out, " ", 1);
+    } else if ((unsigned char)c < 32 || c == 127) {
+      abAppend(out, "^", 1);
+      if (rx + 1 < end) {
+        char p = (c == 127) ? '?' : ('@' + c);
+        abAppend(out, &p, 1);
+      }
+    } else {
+      abAppend(out, &c, 1);
+    }
+    rx += w;
+  }
+  if (current_color != -1)
+    abAppend(out, "\x1b[39m", 5);
+}
+
+/*
+ * editorSelectSyntaxHighlight() - Pick a syntax by the file's extension
+ *
+ * Rows are lexed lazily, so selecting a syntax costs nothing up front;
+ * highlight caches simply start (and stay) invalid until rows are drawn.
+ */
+void editorSelectSyntaxHighlight() {
+  B->syntax = NULL;
+  if (B->filename == NULL)
+    return;
+
+  char *ext = strrchr(B->filename, '.');
+  for (unsigned int j = 0; j < HLDB_ENTRIES; j++) {
+    struct editorSyntax *s = &HLDB[j];
+    unsigned int i = 0;
+    while (s->filematch[i]) {
+      int is_ext = (s->filematch[i][0] == '.');
+      if ((is_ext && ext && !strcmp(ext, s->filematch[i])) ||
+          (!is_ext && strstr(B->filename, s->filematch[i]))) {
+        B->syntax = s;
+        return;
+      }
+      i++;
+    }
+  }
+}
+
+/*** output ***/
+
+/*
+ * Display and Rendering Functions
+ *
+ * This section handles all screen output including:
+ * - Drawing rows of tildes (like vim)
+ * - Screen refresh and clearing
+ */
+
+// prefetch tuning: how many bytes to fault in ahead of the viewport, and
+// how far behind it pages must fall before being handed back to the kernel
+#define KILO_PREFETCH_AHEAD (4 << 20)
+#define KILO_PREFETCH_BEHIND (64 << 20)
+
+/*
+ * editorPrefetch() - Direction-aware readahead for mapped buffers
+ *
+ * Paging through a cold mapped file would otherwise major-fault one page
+ * at a time as the draw loop touches new rows. Each time the viewport
+ * moves, madvise(MADV_WILLNEED) the next few megabytes in the direction
+ * of travel, so the kernel streams them in sequentially while the current
+ * screen is being drawn. The last advised window is remembered and
+ * re-advised only once the viewport outruns it, and a same-sized chunk
+ * trailing far behind the viewport is released with MADV_DONTNEED - the
+ * sweep keeps a long scroll through a 10 GB file from wiring the whole
+ * mapping into memory. A viewport that has not moved costs one compare.
+ */
+void editorPrefetch() {
+  if (!B->filemap_mmapped || B->lineoff == NULL || B->numrows == 0)
+    return;
+  int dir = B->rowoff - B->prefetch_row;
+  B->prefetch_row = B->rowoff;
+  if (dir == 0)
+    return;
+
+  size_t pgmask = (size_t)sysconf(_SC_PAGESIZE) - 1;
+  int toprow = B->rowoff;
+  int botrow = B->rowoff + E.screenrows;
+  if (toprow >= B->numrows)
+    toprow = B->numrows - 1;
+  if (botrow >= B->numrows)
+    botrow = B->numrows - 1;
+  size_t viewstart = B->lineoff[editorRowPhys(toprow)];
+  size_t viewend = B->lineoff[editorRowPhys(botrow)];
+
+  size_t a0, a1;
+  if (dir > 0) {
+    a0 = viewend;
+    a1 = a0 + KILO_PREFETCH_AHEAD;
+    if (a1 > B->filemap_len)
+      a1 = B->filemap_len;
+  } else {
+    a1 = viewstart;
+    a0 = (a1 > KILO_PREFETCH_AHEAD) ? a1 - KILO_PREFETCH_AHEAD : 0;
+  }
+  if (a0 < B->prefetch_lo || a1 > B->prefetch_hi) {
+    size_t lo = a0 & ~pgmask;
+    if (a1 > lo)
+      madvise(B->filemap + lo, a1 - lo, MADV_WILLNEED);
+    B->prefetch_lo = a0;
+    B->prefetch_hi = a1;
+  }
+
+  if (dir > 0 && viewstart > KILO_PREFETCH_BEHIND) {
+    size_t d1 = viewstart - KILO_PREFETCH_BEHIND;
+    size_t d0 = (d1 > KILO_PREFETCH_AHEAD) ? d1 - KILO_PREFETCH_AHEAD : 0;
+    d0 &= ~pgmask;
+    d1 &= ~pgmask;
+    if (d1 > d0)
+      madvise(B->filemap + d0, d1 - d0, MADV_DONTNEED);
+  } else if (dir < 0 && viewend + KILO_PREFETCH_BEHIND < B->filemap_len) {
+    size_t d0 = (viewend + KILO_PREFETCH_BEHIND + pgmask) & ~pgmask;
+    size_t d1 = d0 + KILO_PREFETCH_AHEAD;
+    if (d1 > B->filemap_len)
+      d1 = B->filemap_len;
+    if (d1 > d0)
+      madvise(B->filemap + d0, d1 - d0, MADV_DONTNEED);
+  }
+}
+
+void editorScroll() {
+  // horizontal scrolling works in render columns, not chars indices, so
+  // the cursor lands correctly inside tab-expanded and ^X-rendered text
+  B->rx = 0;
+  if (B->cy < B->numrows)
+    B->rx = editorRowCxToRx(editorRowAt(B->cy), B->cx);
+
+  if (B->wrap) {
+    // wrap mode scrolls in visual lines: translate the cursor and the top
+    // of the screen through the tree, adjust in visual space, translate
+    // back. Rows in between that were never measured count as one visual
+    // line this frame; drawing measures everything that lands in view, so
+    // the mapping is exact by the next frame.
+    editorWrapSync();
+    B->coloff = 0;
+    if (B->rowoff > B->numrows)
+      B->rowoff = B->numrows;
+    if (B->rowoff < B->numrows) {
+      int nv = editorRowVrows(B->rowoff);
+      if (B->rowsub >= nv)
+        B->rowsub = nv - 1;
+    } else {
+      B->rowsub = 0;
+    }
+    long vcur = editorWrapVline(B->cy);
+    if (B->cy < B->numrows)
+      vcur += B->rx / B->wrapcols;
+    long vtop = editorWrapVline(B->rowoff) + B->rowsub;
+    if (vcur < vtop)
+      vtop = vcur;
+    if (vcur >= vtop + E.screenrows)
+      vtop = vcur - E.screenrows + 1;
+    B->rowoff = editorWrapFind(vtop, &B->rowsub);
+  } else {
+    if(B->cy < B->rowoff) {
+      B->rowoff = B->cy;
+    }
+    if(B->cy >= B->rowoff + E.screenrows) {
+      B->rowoff = B->cy - E.screenrows + 1;
+    }
+    if(B->rx < B->coloff) {
+      B->coloff = B->rx;
+    }
+    if(B->rx >= B->coloff + E.screencols) {
+      B->coloff = B->rx - E.screencols + 1;
+    }
+  }
+
+  editorPrefetch();
+}
+
+
+/*
+ * editorDrawRows() - Draw buffer rows on screen, with damage tracking
+ *
+ * Draws file text, or a column of tildes (~) down the left side of the
+ * screen for lines past the end of the buffer, similar to vim.
+ *
+ * Each screen row's content is first composed into a scratch buffer and
+ * compared against E.rowcache[y], the exact bytes emitted for that row last
+ * frame. Rows that are unchanged are skipped entirely; rows that differ are
+ * emitted as an absolute cursor-positioning sequence plus the new content.
+ * For plain cursor movement nothing changed, so nothing is emitted - over a
+ * high-latency SSH link that cuts a full-screen repaint down to a handful
+ * of bytes. E.fullrepaint forces every row out, for the first frame and for
+ * anything that invalidates the cache wholesale.
+ */
+void editorDrawRows(struct abuf *ab) {
+  int y;
+  // wrap mode walks (row, visual line within row) down the screen instead
+  // of deriving the file row from y
+  int wrow = B->rowoff;
+  int wsub = B->rowsub;
+
+  for (y = 0; y < E.screenrows; y++) {
+    int filerow = B->wrap ? wrow : y + B->rowoff;
+    struct abuf *line = &E.linebuf;
+    line->len = 0;
+
+    if(filerow >= B->numrows) {
+      if (B->numrows == 0 && y == E.screenrows / 3) {
+        char welcome[80];
+        int welcomelen = snprintf(welcome, sizeof(welcome),
+                                "Kilo editor -- version %s", KILO_VERSION);
+        if (welcomelen > E.screencols)
+          welcomelen = E.screencols;
+        int padding = (E.screencols - welcomelen) / 2;
+        if (padding) {
+          abAppend(line, "~", 1);
+          padding--;
+        }
+        while (padding--)
+          abAppend(line, " ", 1);
+        abAppend(line, welcome, welcomelen);
+      } else {
+        abAppend(line, "~", 1);
+      }
+    } else {
+      erow *row = editorRowAt(filerow);
+      if (B->wrap) {
+        // every row goes through the slice renderer here: a wrapped
+        // segment is just a viewport slice with its own column offset
+        int rx0 = wsub * B->wrapcols;
+        if (B->syntax)
+          editorRowSliceRenderHl(row, rx0, B->wrapcols, line);
+        else
+          editorRowSliceRender(row, rx0, B->wrapcols, line);
+        if (++wsub >= editorRowVrows(filerow)) {
+          wrow++;
+          wsub = 0;
+        }
+        goto emit;
+      }
+      if (editorRowIsLong(row)) {
+        // long rows bypass the monolithic caches entirely; expand (and
+        // highlight) only the chunk under the viewport
+        if (B->syntax)
+          editorRowSliceRenderHl(row, B->coloff, E.screencols, line);
+        else
+          editorRowSliceRender(row, B->coloff, E.screencols, line);
+        goto emit;
+      }
+      if (row->render == NULL)
+        editorUpdateRow(row);
+      if (B->syntax && !row->hl_valid)
+        editorUpdateSyntax(filerow);
+      int len = row->rsize - B->coloff;
+      if(len < 0) len = 0;
+      if(len > E.screencols) len = E.screencols;
+      if (B->syntax == NULL) {
+        abAppend(line, &row->render[B->coloff], len);
+      } else {
+        // emit color escape codes straight from the highlight cache,
+        // switching colors only at run boundaries; no lexing happens here
+        char *c = &row->render[B->coloff];
+        unsigned char *hl = &row->hl[B->coloff];
+        int current_color = -1;
+        for (int j = 0; j < len; j++) {
+          if (hl[j] == HL_NORMAL) {
+            if (current_color != -1) {
+              abAppend(line, "\x1b[39m", 5);
+              current_color = -1;
+            }
+            abAppend(line, &c[j], 1);
+          } else {
+            int color = editorSyntaxToColor(hl[j]);
+            if (color != current_color) {
+              current_color = color;
+              char buf[16];
+              int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
+              abAppend(line, buf, clen);
+            }
+            abAppend(line, &c[j], 1);
+          }
+        }
+        if (current_color != -1)
+          abAppend(line, "\x1b[39m", 5);
+      }
+    }
+
+emit:;
+    struct abuf *cache = &E.rowcache[y];
+    if (!E.fullrepaint && cache->len == line->len &&
+        (line->len == 0 || memcmp(cache->b, line->b, line->len) == 0))
+      continue;
+
+    char pos[16];
+    snprintf(pos, sizeof(pos), "\x1b[%d;1H", y + 1);
+    abAppend(ab, pos, strlen(pos));
+    abAppend(ab, line->b, line->len);
+    abAppend(ab, "\x1b[K", 3);
+
+    cache->len = 0;
+    abAppend(cache, line->b, line->len);
+  }
+
+  E.fullrepaint = 0;
+}
+
+/*
+ * editorRefreshScreen() - Clear screen and redraw
  *
  * Escape sequences used:
  * - <esc>[2J : Clear entire screen (J command with arg 2)
@@ -593,24 +3154,87 @@ void editorDrawRows(struct abuf *ab) {
  *
  * We use VT100 sequences for broad terminal emulator compatibility.
  */
-void editorRefreshScreen() {
-  editorScroll();
-
-  struct abuf ab = ABUF_INIT;
+/*
+ * editorDrawHud() - One inverse-video line of instrumentation
+ *
+ * Shows the previous frame's timing and per-frame deltas of the hot-path
+ * counters. Drawn over the bottom screen row like the search prompt, with
+ * the same damage-cache sentinel so whatever it covered repaints cleanly.
+ */
+void editorDrawHud(struct abuf *ab) {
+  char line[256];
+  int n = snprintf(line, sizeof(line),
+                   "frame %.2fms (max %.2f) | %ldB out | %ld abAppend | "
+                   "%ld rows mat | inq %ld",
+                   S.frame_ms, S.frame_ms_max, S.bytes - S.prev_bytes,
+                   S.abappends - S.prev_abappends,
+                   S.rows_materialized - S.prev_rows, S.inqueue);
+  if (n > E.screencols)
+    n = E.screencols;
+  char pos[16];
+  snprintf(pos, sizeof(pos), "\x1b[%d;1H", E.screenrows);
+  abAppend(ab, pos, strlen(pos));
+  abAppend(ab, "\x1b[7m", 4);
+  abAppend(ab, line, n);
+  abAppend(ab, "\x1b[m\x1b[K", 6);
+  E.rowcache[E.screenrows - 1].len = -1;
+}
 
-  abAppend(&ab, "\x1b[?25l", 6);
-  abAppend(&ab, "\x1b[H", 3);
+void editorRefreshScreen() {
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  S.prev_bytes = S.bytes;
+  S.prev_abappends = S.abappends;
+  S.prev_rows = S.rows_materialized;
+  S.inqueue = E.inlen - E.inpos;
 
-  editorDrawRows(&ab);
+  editorScroll();
 
+  // the frame buffer persists on E across refreshes: resetting len to 0
+  // keeps the capacity from previous frames, so steady-state scrolling does
+  // not touch the allocator at all.
+  struct abuf *ab = &E.frame;
+  ab->len = 0;
+
+  abAppend(ab, "\x1b[?25l", 6);
+
+  editorDrawRows(ab);
+
+  if (S.hud)
+    editorDrawHud(ab);
+
+  int cyscr = B->cy - B->rowoff;
+  int cxscr = B->rx - B->coloff;
+  if (B->wrap) {
+    // drawing just measured every visible row, so these prefix sums are
+    // exact for anything on screen
+    long vtop = editorWrapVline(B->rowoff) + B->rowsub;
+    long vcur = editorWrapVline(B->cy);
+    if (B->cy < B->numrows)
+      vcur += B->rx / B->wrapcols;
+    cyscr = (int)(vcur - vtop);
+    cxscr = B->rx % B->wrapcols;
+  }
   char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.cy - E.rowoff), (E.cx - E.coloff) + 1);
-  abAppend(&ab, buf, strlen(buf));
-
-  abAppend(&ab, "\x1b[?25h", 6);
-
-  write(STDOUT_FILENO, ab.b, ab.len);
-  abFree(&ab);
+  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", cyscr + 1, cxscr + 1);
+  abAppend(ab, buf, strlen(buf));
+
+  abAppend(ab, "\x1b[?25h", 6);
+
+#ifdef KILO_BENCH
+  bench_frames++;
+  bench_bytes += ab->len;
+#endif
+  write(STDOUT_FILENO, ab->b, ab->len);
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  S.frame_ms =
+      (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+  S.frame_ms_total += S.frame_ms;
+  if (S.frame_ms > S.frame_ms_max)
+    S.frame_ms_max = S.frame_ms;
+  S.frames++;
+  S.bytes += ab->len;
 }
 // write() and STDOUT_FILENO come from <unistd.h>.
 // the 4 in our write() call means we are writing 4 bytes out to the terminal.
@@ -641,44 +3265,346 @@ void editorRefreshScreen() {
 // the h and l commands (Set Mode, Reset Mode) are used to turn on and turn
 // off various terminal features or “modes”.
 
+/*** find ***/
+
+/*
+ * Incremental search with a persistent match index
+ *
+ * The match list for the current query lives on editorConfig and is kept
+ * sorted by (row, col). Three cost tiers:
+ *
+ *  - first scan of a query: for a pristine buffer (no edits yet - the huge
+ *    log-file case) we run memmem() straight over the contiguous file
+ *    buffer, one vectorized pass with no per-row call overhead, converting
+ *    hit offsets to row/col with a forward-advancing cursor into the line
+ *    index. Once the buffer has been edited, rows no longer mirror the file
+ *    bytes, so we fall back to memmem() per row.
+ *  - refining the query (typing one more character): every match of the
+ *    longer query is a match of the prefix, so we just filter the cached
+ *    list in place - microseconds even with millions of hits.
+ *  - n/N navigation: binary search of the cached list, no rescan at all.
+ *
+ * Structural edits set matchdirty, which forces the next scan to start
+ * fresh.
+ */
+
+// below this file size the fan-out bookkeeping costs more than the scan
+#define KILO_PARALLEL_SEARCH_MIN (1 << 22)
+
+/*
+ * Parallel whole-file search
+ *
+ * The pristine-buffer scan is data-parallel in the same shape as the line
+ * indexer: the file is cut into one contiguous byte slice per worker, and
+ * each worker memmem()s its slice into a private hit vector - no shared
+ * state, no locks. A match belongs to the slice holding its first byte;
+ * slices overlap their right edge by qlen-1 bytes so straddling matches
+ * are not lost. The main thread merges the vectors in slice order (they
+ * are already sorted) while converting byte offsets to row/col, so a
+ * count over a huge file uses every core and the input thread only pays
+ * for the merge.
+ */
+struct searchRange {
+  const char *base;
+  size_t start, end;   // matches starting in [start, end) are this slice's
+  size_t limit;        // scan window end: end + qlen - 1, clamped to file
+  const char *query;
+  int qlen;
+  size_t *hits;
+  int nhits, hitcap;
+};
+
+void searchRangeScan(void *arg) {
+  struct searchRange *r = (struct searchRange *)arg;
+  const char *p = r->base + r->start;
+  const char *owned = r->base + r->end;
+  const char *lim = r->base + r->limit;
+  while (p < owned) {
+    const char *hit = memmem(p, lim - p, r->query, r->qlen);
+    if (hit == NULL || hit >= owned)
+      break;
+    if (r->nhits == r->hitcap) {
+      r->hitcap = r->hitcap ? r->hitcap * 2 : 256;
+      r->hits = realloc(r->hits, sizeof(size_t) * r->hitcap);
+      if (r->hits == NULL)
+        die("realloc");
+    }
+    r->hits[r->nhits++] = hit - r->base;
+    p = hit + 1;
+  }
+}
+
+void editorMatchesPush(int row, int col) {
+  if (B->nmatches == B->matchcap) {
+    B->matchcap = B->matchcap ? B->matchcap * 2 : 256;
+    B->matches = realloc(B->matches, sizeof(struct searchMatch) * B->matchcap);
+    if (B->matches == NULL)
+      die("realloc");
+  }
+  B->matches[B->nmatches].row = row;
+  B->matches[B->nmatches].col = col;
+  B->nmatches++;
+}
+
+void editorSearchRescan(const char *query, int qlen) {
+  if (!B->matchdirty && B->matchquerylen > 0 && qlen > B->matchquerylen &&
+      memcmp(query, B->matchquery, B->matchquerylen) == 0) {
+    // refinement: filter the cached matches of the prefix
+    int kept = 0;
+    for (int i = 0; i < B->nmatches; i++) {
+      erow *row = editorRowAt(B->matches[i].row);
+      if (B->matches[i].col + qlen <= row->size &&
+          memcmp(row->chars + B->matches[i].col, query, qlen) == 0)
+        B->matches[kept++] = B->matches[i];
+    }
+    B->nmatches = kept;
+  } else {
+    B->nmatches = 0;
+    if (qlen > 0 && !B->bufedited && B->filemap && B->lineoff &&
+        B->filemap_len >= KILO_PARALLEL_SEARCH_MIN && E.pool.nthreads > 1) {
+      // pristine big buffer: fan the byte range out across the pool
+      int nranges = E.pool.nthreads;
+      struct searchRange *ranges = calloc(nranges, sizeof(struct searchRange));
+      if (ranges == NULL)
+        die("calloc");
+      size_t chunk = B->filemap_len / nranges;
+      for (int i = 0; i < nranges; i++) {
+        ranges[i].base = B->filemap;
+        ranges[i].start = chunk * i;
+        ranges[i].end =
+            (i == nranges - 1) ? B->filemap_len : chunk * (i + 1);
+        ranges[i].limit = ranges[i].end + qlen - 1;
+        if (ranges[i].limit > B->filemap_len)
+          ranges[i].limit = B->filemap_len;
+        ranges[i].query = query;
+        ranges[i].qlen = qlen;
+        poolSubmit(searchRangeScan, NULL, &ranges[i]);
+      }
+      poolWait();
+      int rowcur = 0;
+      for (int i = 0; i < nranges; i++) {
+        for (int j = 0; j < ranges[i].nhits; j++) {
+          size_t off = ranges[i].hits[j];
+          while (rowcur + 1 < B->numrows &&
+                 B->lineoff[editorRowPhys(rowcur + 1)] <= off)
+            rowcur++;
+          editorMatchesPush(rowcur, off - B->lineoff[editorRowPhys(rowcur)]);
+        }
+        free(ranges[i].hits);
+      }
+      free(ranges);
+    } else if (qlen > 0 && !B->bufedited && B->filemap && B->lineoff) {
+      // pristine buffer: one contiguous scan of the whole file
+      char *base = B->filemap;
+      char *p = base;
+      char *end = base + B->filemap_len;
+      int rowcur = 0;
+      while (p < end) {
+        char *hit = memmem(p, end - p, query, qlen);
+        if (hit == NULL)
+          break;
+        size_t off = hit - base;
+        while (rowcur + 1 < B->numrows &&
+               B->lineoff[editorRowPhys(rowcur + 1)] <= off)
+          rowcur++;
+        editorMatchesPush(rowcur, off - B->lineoff[editorRowPhys(rowcur)]);
+        p = hit + 1;
+      }
+    } else if (qlen > 0) {
+      // edited buffer: rows no longer mirror the file bytes
+      for (int at = 0; at < B->numrows; at++) {
+        erow *row = editorRowAt(at);
+        char *p = row->chars;
+        int rem = row->size;
+        while (rem >= qlen) {
+          char *hit = memmem(p, rem, query, qlen);
+          if (hit == NULL)
+            break;
+          editorMatchesPush(at, hit - row->chars);
+          rem -= (hit - p) + 1;
+          p = hit + 1;
+        }
+      }
+    }
+  }
+  memcpy(B->matchquery, query, qlen);
+  B->matchquerylen = qlen;
+  B->matchdirty = 0;
+}
+
+/*
+ * editorMatchLowerBound() - First index in the match list >= (row, col)
+ */
+int editorMatchLowerBound(int row, int col) {
+  int lo = 0, hi = B->nmatches;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    struct searchMatch *m = &B->matches[mid];
+    if (m->row < row || (m->row == row && m->col < col))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+void editorFindNext(int dir) {
+  if (B->nmatches == 0)
+    return;
+  int idx;
+  if (dir > 0) {
+    idx = editorMatchLowerBound(B->cy, B->cx + 1);
+    if (idx == B->nmatches)
+      idx = 0;
+  } else {
+    idx = editorMatchLowerBound(B->cy, B->cx) - 1;
+    if (idx < 0)
+      idx = B->nmatches - 1;
+  }
+  B->cy = B->matches[idx].row;
+  B->cx = B->matches[idx].col;
+}
+
+/*
+ * editorFind() - Modal incremental search prompt (Ctrl-F)
+ *
+ * Runs its own little event loop: the screen refreshes behind a one-line
+ * prompt overlaid on the bottom row (whose damage cache is invalidated so
+ * the next ordinary frame repaints it). Typing extends the query and jumps
+ * to the first match at or after where the search started; arrows step
+ * through matches via the cached index; Enter accepts the position, ESC
+ * restores cursor and scroll exactly as they were.
+ */
+void editorFind() {
+  char query[256];
+  int qlen = 0;
+  int saved_cx = B->cx, saved_cy = B->cy;
+  int saved_rowoff = B->rowoff, saved_coloff = B->coloff;
+
+  for (;;) {
+    editorRefreshScreen();
+    // the prompt doubles as the whole-file count surface: (current/total)
+    // of the cached match list, which the parallel scan just filled
+    int cur = editorMatchLowerBound(B->cy, B->cx);
+    int atmatch = (cur < B->nmatches && B->matches[cur].row == B->cy &&
+                   B->matches[cur].col == B->cx);
+    char prompt[320];
+    int plen = snprintf(prompt, sizeof(prompt),
+                        "\x1b[%d;1H\x1b[7mSearch (%d/%d): %.*s\x1b[m\x1b[K",
+                        E.screenrows, atmatch ? cur + 1 : 0, B->nmatches,
+                        qlen, query);
+    write(STDOUT_FILENO, prompt, plen);
+    E.rowcache[E.screenrows - 1].len = -1;
+
+    int c = editorReadKey();
+    if (c == '\r') {
+      break;
+    } else if (c == '\x1b' || c == CTRL_KEY('q')) {
+      B->cx = saved_cx;
+      B->cy = saved_cy;
+      B->rowoff = saved_rowoff;
+      B->coloff = saved_coloff;
+      break;
+    } else if (c == 127 || c == CTRL_KEY('h')) {
+      if (qlen > 0)
+        qlen--;
+    } else if (c == ARROW_RIGHT || c == ARROW_DOWN || c == CTRL_KEY('n')) {
+      editorFindNext(1);
+      continue;
+    } else if (c == ARROW_LEFT || c == ARROW_UP || c == CTRL_KEY('p')) {
+      editorFindNext(-1);
+      continue;
+    } else if (c == HOME_KEY || c == END_KEY || c == PAGE_UP ||
+               c == PAGE_DOWN) {
+      // jump within the match list instead of one match at a time:
+      // Home/End go to the first/last match, PageUp/PageDown leap by 10
+      if (B->nmatches > 0) {
+        int idx = editorMatchLowerBound(B->cy, B->cx);
+        if (c == HOME_KEY)
+          idx = 0;
+        else if (c == END_KEY)
+          idx = B->nmatches - 1;
+        else if (c == PAGE_DOWN)
+          idx = (idx + 10 < B->nmatches) ? idx + 10 : B->nmatches - 1;
+        else
+          idx = (idx > 10) ? idx - 10 : 0;
+        B->cy = B->matches[idx].row;
+        B->cx = B->matches[idx].col;
+      }
+      continue;
+    } else if (c >= 32 && c < 127 && qlen < (int)sizeof(query) - 1) {
+      query[qlen++] = c;
+    } else {
+      continue;
+    }
+
+    editorSearchRescan(query, qlen);
+    if (B->nmatches > 0) {
+      int idx = editorMatchLowerBound(saved_cy, saved_cx);
+      if (idx == B->nmatches)
+        idx = 0;
+      B->cy = B->matches[idx].row;
+      B->cx = B->matches[idx].col;
+    } else {
+      B->cx = saved_cx;
+      B->cy = saved_cy;
+    }
+  }
+
+  E.fullrepaint = 1;
+}
+
 /*** input ***/
 
+// rows are materialized only when their text is actually read: horizontal
+// moves step through bytes, but vertical moves and the end-of-move clamp
+// get by on editorRowLen() alone, so paging through an unmaterialized file
+// touches the offset index rather than filling in erow structs
 void editorMoveCursor(int key) {
-  erow *row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
-
   switch (key) {
   case ARROW_LEFT:
-    if (E.cx != 0) {
-      E.cx--;
-    } else if (E.cy > 0) {
-      E.cy--;
-      E.cx = E.row[E.cy].size;
+    if (B->cx != 0) {
+      erow *row = editorRowAt(B->cy);
+      B->cx = row ? editorRowPrevChar(row, B->cx) : B->cx - 1;
+    } else if (B->cy > 0) {
+      B->cy--;
+      B->cx = editorRowLen(B->cy);
     }
     break;
   case ARROW_RIGHT:
-    if(row && E.cx < row->size) {
-      E.cx++;
-    } else if (row && E.cx == row->size) {
-      E.cy++;
-      E.cx = 0;
+    if (B->cy < B->numrows) {
+      int len = editorRowLen(B->cy);
+      if (B->cx < len) {
+        B->cx = editorRowNextChar(editorRowAt(B->cy), B->cx);
+      } else {
+        B->cy++;
+        B->cx = 0;
+      }
     }
     break;
   case ARROW_UP:
-    if (E.cy != 0) {
-      E.cy--;
+    if (B->cy != 0) {
+      B->cy--;
     }
     break;
   case ARROW_DOWN:
-    if (E.cy < E.numrows) {
-      E.cy++;
+    if (B->cy < B->numrows) {
+      B->cy++;
     }
     break;
   }
 
-  row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
-  int rowlen = row ? row->size : 0;
-  if(E.cx > rowlen) {
-    E.cx = rowlen;
+  int rowlen = editorRowLen(B->cy);
+  if(B->cx > rowlen) {
+    B->cx = rowlen;
+  }
+  // never leave the cursor inside a UTF-8 sequence after a vertical move;
+  // only a cursor strictly inside the row needs the text itself
+  if (B->cx > 0 && B->cx < rowlen) {
+    erow *row = editorRowAt(B->cy);
+    while (B->cx > 0 &&
+           ((unsigned char)row->chars[B->cx] & 0xC0) == 0x80)
+      B->cx--;
   }
 }
 
@@ -688,6 +3614,84 @@ void editorMoveCursor(int key) {
  * This section handles user input and keypress processing.
  */
 
+/*
+ * editorHandlePaste() - Bulk-insert a bracketed paste
+ *
+ * Called when editorReadKey() sees the ESC[200~ open delimiter. The raw
+ * payload is collected into one buffer until the ESC[201~ terminator, then
+ * split into lines and inserted into the row table as a single block:
+ * one gap-opening memmove, one arena copy per line, one redraw when the
+ * main loop regains control. Processing a 5,000-line paste as 5,000
+ * keypress/refresh cycles is exactly the lockup this avoids.
+ */
+void editorHandlePaste() {
+  struct abuf paste = ABUF_INIT;
+
+  // collect payload bytes, matching the terminator incrementally so a
+  // partial match that turns out to be payload is appended verbatim
+  const char *endmark = "\x1b[201~";
+  int matched = 0;
+  for (;;) {
+    int b = inputNextByte(-1);
+    if (b == -1)
+      break;
+    char ch = b;
+    if (ch == endmark[matched]) {
+      matched++;
+      if (endmark[matched] == '\0')
+        break;
+      continue;
+    }
+    if (matched) {
+      abAppend(&paste, endmark, matched);
+      matched = 0;
+    }
+    if (ch == endmark[0]) {
+      matched = 1;
+      continue;
+    }
+    abAppend(&paste, &ch, 1);
+  }
+
+  if (paste.len == 0) {
+    abFree(&paste);
+    return;
+  }
+
+  // count the lines, open one gap, then fill it
+  int nlines = 0;
+  char *p = paste.b;
+  char *end = paste.b + paste.len;
+  while (p < end) {
+    nlines++;
+    char *nl = memchr(p, '\n', end - p);
+    p = nl ? nl + 1 : end;
+  }
+
+  int at = (B->cy < B->numrows) ? B->cy : B->numrows;
+  editorRecordEdit(EDIT_INSERT_ROWS, at, nlines, NULL, B->cx, B->cy);
+  editorOpenRowGap(at, nlines);
+
+  p = paste.b;
+  int i = at;
+  while (p < end) {
+    char *nl = memchr(p, '\n', end - p);
+    size_t len = nl ? (size_t)(nl - p) : (size_t)(end - p);
+    if (len > 0 && p[len - 1] == '\r')
+      len--;
+    editorFillRow(i, p, len);
+    i++;
+    p = nl ? nl + 1 : end;
+  }
+
+  B->cy = at + nlines;
+  if (B->cy > B->numrows)
+    B->cy = B->numrows;
+  B->cx = 0;
+
+  abFree(&paste);
+}
+
 /*
  * editorProcessKeypress() - Handle user input
  *
@@ -706,19 +3710,101 @@ void editorProcessKeypress() {
     break;
 
   case HOME_KEY:
-    E.cx = 0;
+    B->cx = 0;
     break;
 
   case END_KEY:
-    E.cx = E.screencols - 1;
+    B->cx = E.screencols - 1;
     break;
 
   case PAGE_UP:
   case PAGE_DOWN:
   {
-    int times = E.screenrows;
+    // jump a whole screen at once instead of stepping row by row - the
+    // intermediate rows are never looked at, so they should not be
+    // materialized either. The final editorMoveCursor() step does the
+    // usual clamp and UTF-8 snap on the destination row only.
+    int times = E.screenrows - 1;
+    if (c == PAGE_UP) {
+      B->cy -= times;
+      if (B->cy < 0)
+        B->cy = 0;
+    } else {
+      B->cy += times;
+      if (B->cy > B->numrows)
+        B->cy = B->numrows;
+    }
+    editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
+  }
+  break;
+
+  case PASTE_START:
+    editorHandlePaste();
+    break;
+
+  case CTRL_KEY('k'):
+    // delete the current line, undoably: capture the row's (shared) text
+    // span before absorbing it into the gap
+    if (B->cy < B->numrows) {
+      editorRecordEdit(EDIT_DELETE_ROWS, B->cy, 1, editorCaptureRows(B->cy, 1),
+                       B->cx, B->cy);
+      editorDeleteRows(B->cy, 1);
+      if (B->cy > B->numrows)
+        B->cy = B->numrows;
+      B->cx = 0;
+    }
+    break;
+
+  case CTRL_KEY('f'):
+    editorFind();
+    break;
+
+  case CTRL_KEY('s'):
+    // IXON is off in raw mode, so Ctrl-S reaches us instead of freezing
+    // the terminal
+    editorSave();
+    break;
+
+  case CTRL_KEY('z'):
+    editorUndo();
+    break;
+
+  case CTRL_KEY('y'):
+    editorRedo();
+    break;
+
+  case CTRL_KEY('b'):
+    // cycle to the next open buffer
+    if (E.nbufs > 1)
+      editorBufferSwitch((E.curbuf + 1) % E.nbufs);
+    break;
+
+  case CTRL_KEY('t'):
+    editorToggleFollow();
+    break;
+
+  case CTRL_KEY('w'):
+    // toggle soft word wrap for this buffer; the reflow cache survives
+    // the toggle, so flipping back and forth at the same width is free
+    B->wrap = !B->wrap;
+    B->coloff = 0;
+    B->rowsub = 0;
+    E.fullrepaint = 1;
+    break;
+
+  case CTRL_KEY('g'):
+    // toggle the instrumentation HUD
+    S.hud = !S.hud;
+    E.fullrepaint = 1;
+    break;
+
+  case WHEEL_UP:
+  case WHEEL_DOWN:
+  {
+    // scroll wheel moves three lines per notch, matching most terminals
+    int times = 3;
     while (times--)
-      editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
+      editorMoveCursor(c == WHEEL_UP ? ARROW_UP : ARROW_DOWN);
   }
   break;
 
@@ -731,31 +3817,96 @@ void editorProcessKeypress() {
   }
 }
 
+/*
+ * editorProcessInput() - Drain the whole key-event queue before repainting
+ *
+ * The old loop consumed exactly one key per screen refresh, so a held-down
+ * arrow key or a paste made the editor fall further and further behind the
+ * terminal. Here we process every buffered key (topping the buffer up
+ * non-blockingly in case more arrived while we worked) and only then return
+ * to the main loop for a single redraw - consecutive cursor moves coalesce
+ * into one frame.
+ */
+void editorProcessInput() {
+  do {
+    editorProcessKeypress();
+    inputRefill(0);
+  } while (editorPendingInput());
+}
+
 /*
  * initEditor() - Initialize editor state
  *
- * Sets up the global editor configuration, including detecting the current
- * terminal window dimensions.
+ * Sets up the shared terminal-side state - window dimensions, frame and
+ * damage buffers, signal handling, the worker pool - and creates the
+ * first (empty) buffer. Per-buffer fields are all zero at birth, which
+ * calloc in editorBufferAdd() takes care of.
  */
 void initEditor() {
-  E.cx = 0;
-  E.cy = 0;
-  E.rowoff = 0;
-  E.coloff = 0;
-  E.numrows = 0;
-  E.row = NULL;
-
+  E.bufs = NULL;
+  E.nbufs = 0;
+  E.bufcap = 0;
+  E.curbuf = 0;
+  E.bufclock = 0;
+  // nonblocking so editorCheckFollow() can drain it opportunistically
+  E.inotfd = inotify_init1(IN_NONBLOCK);
+  E.frame.b = NULL;
+  E.frame.len = 0;
+  E.frame.cap = 0;
+  E.linebuf.b = NULL;
+  E.linebuf.len = 0;
+  E.linebuf.cap = 0;
+  E.inlen = 0;
+  E.inpos = 0;
+
+#ifdef KILO_BENCH
+  // headless: no tty to measure, so pick a fixed, typical window
+  E.screenrows = 40;
+  E.screencols = 120;
+#else
   if (getWindowSize(&E.screenrows, &E.screencols) == -1)
     die("getWindowSize");
+#endif
+
+  // one cached line per screen row; calloc leaves each abuf empty, and
+  // fullrepaint makes sure the very first frame paints everything.
+  E.rowcache = calloc(E.screenrows, sizeof(struct abuf));
+  if (E.rowcache == NULL)
+    die("calloc");
+  E.fullrepaint = 1;
+
+  // deliberately no SA_RESTART: the signal must interrupt the idle poll()
+  // so the resize is handled right away instead of after the next keypress
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handleSigwinch;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGWINCH, &sa, NULL) == -1)
+    die("sigaction");
+
+  if (getenv("KILO_STATS"))
+    atexit(statsDump);
+
+  poolInit();
+
+  int first = editorBufferAdd();
+  B = E.bufs[first];
 }
 
 /*** init ***/
+#ifndef KILO_BENCH
 int main(int argc, char *argv[]) {
   enableRawMode();
   initEditor();
-  if (argc >= 2) {
-    editorOpen(argv[1]);
+  // every filename on the command line gets its own buffer; Ctrl-B cycles
+  // through them. We end up back on the first one.
+  for (int i = 1; i < argc; i++) {
+    if (i > 1)
+      editorBufferSwitch(editorBufferAdd());
+    editorOpen(argv[i]);
   }
+  if (argc > 2)
+    editorBufferSwitch(0);
   // initEditor()’s job will be to initialize all the fields in the E struct.
 
   // read() and STDIN_FILENO come from <unistd.h>.
@@ -770,11 +3921,17 @@ int main(int argc, char *argv[]) {
   // screen. ASCII codes 0-31 are all control characters, and 127 is also a
   // control character. ASCII codes 32-216 are all printable.
   while (1) {
+    editorCheckResize();
+    editorCheckFollow();
+    poolDrain();
     editorRefreshScreen();
-    editorProcessKeypress();
+    editorWaitForEvent();
+    if (editorPendingInput())
+      editorProcessInput();
   }
-  // added a timeout for read(), so that read() returns if it doesn’t get any
-  // input for a certain amount of time.
+  // the loop is event-driven: after painting a frame we block in poll()
+  // until input (or a signal) arrives, then process it and repaint. there
+  // is no periodic wakeup any more.
 
   // errno and EAGAIN come from <errno.h>.
   // tcsetattr(), tcgetattr(), and read() all return -1 on failure, and set the
@@ -785,3 +3942,117 @@ int main(int argc, char *argv[]) {
   // write out the byte directly, as a character.
   return 0;
 }
+#endif /* !KILO_BENCH */
+
+/*** bench ***/
+
+/*
+ * Headless replay harness, compiled only with -DKILO_BENCH (make bench).
+ *
+ * The driver replaces main(): it skips raw mode and the window-size query,
+ * opens the file named on the command line, and replays a recorded
+ * keystroke scenario by pushing bytes straight into the input buffer that
+ * editorReadKey() parses - the exact code path a terminal would exercise,
+ * minus the terminal. Output goes wherever stdout points (the Makefile
+ * sends it to /dev/null); the report goes to stderr.
+ *
+ * Per scenario we report wall time, frames rendered, bytes emitted (both
+ * counted inside editorRefreshScreen(), so modal loops like the search
+ * prompt are included) and peak RSS. This is the gate every performance
+ * change gets measured against.
+ */
+#ifdef KILO_BENCH
+
+#include <sys/resource.h>
+#include <time.h>
+
+/*
+ * benchFeed() - Push raw bytes into the keyboard input buffer
+ *
+ * Compacts consumed bytes first; a scenario step must fit in the buffer,
+ * which bounds one step at KILO_INBUF_SIZE bytes of keystrokes.
+ */
+void benchFeed(const char *s, size_t len) {
+  if (E.inpos > 0) {
+    memmove(E.inbuf, E.inbuf + E.inpos, E.inlen - E.inpos);
+    E.inlen -= E.inpos;
+    E.inpos = 0;
+  }
+  if (len > (size_t)(KILO_INBUF_SIZE - E.inlen)) {
+    fprintf(stderr, "bench: step larger than input buffer\n");
+    exit(1);
+  }
+  memcpy(E.inbuf + E.inlen, s, len);
+  E.inlen += (int)len;
+}
+
+// process everything fed so far, painting after each key like the
+// interactive loop does
+void benchDrain() {
+  while (editorPendingInput()) {
+    editorProcessKeypress();
+    editorRefreshScreen();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: kilo_bench <open|scroll|search|paste> <file> [query]\n");
+    return 1;
+  }
+  const char *scenario = argv[1];
+
+  initEditor();
+
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+
+  editorOpen(argv[2]);
+  editorRefreshScreen();
+
+  if (!strcmp(scenario, "open")) {
+    // open + first paint only: measures indexing and time-to-first-frame
+  } else if (!strcmp(scenario, "scroll")) {
+    for (int i = 0; i < 1000; i++) {
+      benchFeed("\x1b[6~", 4);
+      benchDrain();
+    }
+  } else if (!strcmp(scenario, "search")) {
+    const char *query = (argc > 3) ? argv[3] : "x";
+    benchFeed("\x06", 1);
+    benchFeed(query, strlen(query));
+    benchFeed("\r", 1);
+    benchDrain();
+  } else if (!strcmp(scenario, "paste")) {
+    // 50 bracketed-paste blocks of 40 lines each; every block is one
+    // gap-open and one redraw, same as a terminal paste
+    for (int i = 0; i < 50; i++) {
+      struct abuf block = ABUF_INIT;
+      abAppend(&block, "\x1b[200~", 6);
+      for (int j = 0; j < 40; j++) {
+        char line[64];
+        int n = snprintf(line, sizeof(line), "pasted line %d-%d\n", i, j);
+        abAppend(&block, line, n);
+      }
+      abAppend(&block, "\x1b[201~", 6);
+      benchFeed(block.b, block.len);
+      benchDrain();
+      abFree(&block);
+    }
+  } else {
+    fprintf(stderr, "bench: unknown scenario '%s'\n", scenario);
+    return 1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  double wall =
+      (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  fprintf(stderr, "%-8s %8.3fs wall  %6ld frames  %10ld bytes  %8ld KB peak RSS\n",
+          scenario, wall, bench_frames, bench_bytes, ru.ru_maxrss);
+  return 0;
+}
+
+#endif /* KILO_BENCH */